@@ -0,0 +1,169 @@
+/**
+ * @file submitBench.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "mpscRing.h"
+#include "scheduler.h"
+#include "types.h"
+
+#include <asio/executor_work_guard.hpp>
+#include <asio/io_service.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> allocations{0};
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Stands for the reply context a NIF keeps in its callback.
+ */
+struct Reply {
+    std::array<char, 56> context;
+};
+
+double nanosPerOp(Clock::time_point start, std::size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start)
+               .count() /
+        ops;
+}
+
+/**
+ * Wraps a reply callback the way a connection and a shard do, and returns the
+ * task posted to the scheduler.
+ */
+cb::Scheduler::Task makeTask(std::atomic<std::size_t> &done)
+{
+    Reply reply{};
+    cb::Callback<int> callback{
+        [reply, &done](const int &) { done += reply.context.size() > 0; }};
+    cb::TrackedCallback<int> tracked{
+        [ ops = std::size_t{1}, bytes = std::size_t{0},
+            callback = std::move(callback) ](const int &response) mutable {
+            callback(response + static_cast<int>(ops + bytes));
+        }};
+    return [ tracked = std::move(tracked), request = std::vector<int>{} ](
+        lcb_error_t err) mutable { tracked(err + request.size()); };
+}
+
+void benchCallbacks(std::size_t ops)
+{
+    std::atomic<std::size_t> done{0};
+    auto before = allocations.load();
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < ops; ++i) {
+        makeTask(done)(LCB_SUCCESS);
+    }
+    auto nanos = nanosPerOp(start, ops);
+    std::printf("callbacks: %.1f ns/op, %.2f allocations/op\n", nanos,
+        static_cast<double>(allocations - before) / ops);
+}
+
+void benchRing(std::size_t ops)
+{
+    std::atomic<std::size_t> done{0};
+    cb::MpscRing<cb::Scheduler::Task> ring{1024};
+    auto before = allocations.load();
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < ops; i += 512) {
+        for (std::size_t j = 0; j < 512; ++j) {
+            ring.push(makeTask(done));
+        }
+        ring.consume(
+            [](cb::Scheduler::Task &&task) { task(LCB_SUCCESS); });
+    }
+    auto nanos = nanosPerOp(start, ops);
+    std::printf("ring: %.1f ns/op, %.2f allocations/op\n", nanos,
+        static_cast<double>(allocations - before) / ops);
+}
+
+void benchSubmit(std::size_t producers, std::size_t ops)
+{
+    asio::io_service ioService;
+    auto work = asio::make_work_guard(ioService);
+    std::thread consumer{[&] { ioService.run(); }};
+
+    auto &scheduler = asio::use_service<cb::Scheduler>(ioService);
+    auto qosClass = std::make_shared<cb::QosClass>("bench");
+    std::atomic<std::size_t> posted{0};
+    std::atomic<std::size_t> done{0};
+    auto perProducer = ops / producers;
+
+    auto before = allocations.load();
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < producers; ++i) {
+        threads.emplace_back([&] {
+            cb::Schedule schedule{-1, qosClass};
+            for (std::size_t j = 0; j < perProducer; ++j) {
+                // Tasks in flight are kept below the size of the ring, whose
+                // overflow queue allocates every submission.
+                while (posted - done >= 512) {
+                    std::this_thread::yield();
+                }
+                ++posted;
+                scheduler.post(schedule, 1, 0, makeTask(done));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    while (done < perProducer * producers) {
+        std::this_thread::yield();
+    }
+    auto nanos = nanosPerOp(start, perProducer * producers);
+    auto allocated = allocations - before;
+
+    work.reset();
+    consumer.join();
+    std::printf("submit (%zu producers): %.1f ns/op, %.2f allocations/op\n",
+        producers, nanos,
+        static_cast<double>(allocated) / (perProducer * producers));
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    if (auto p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+/**
+ * Measures the submit path of a request without a Couchbase cluster: building
+ * its callbacks, passing them through the ring, and posting them to a
+ * scheduler from several threads.
+ */
+int main(int argc, char *argv[])
+{
+    std::size_t ops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    benchCallbacks(ops);
+    benchRing(ops);
+    for (std::size_t producers : {1, 2, 4}) {
+        benchSubmit(producers, ops);
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file arena.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+struct Current {
+    bool active = false;
+    cb::ArenaPtr arena;
+};
+
+thread_local Current current;
+} // namespace
+
+namespace cb {
+
+Arena::~Arena()
+{
+    if (m_env) {
+        enif_free_env(m_env);
+    }
+}
+
+void *Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto padding = (alignment - reinterpret_cast<std::uintptr_t>(m_next) %
+                       alignment) % alignment;
+    if (!m_next || padding + size > m_left) {
+        // Blocks double in size, so a batch needs a logarithmic number of
+        // them however large it is.
+        auto blockSize = std::max(m_nextBlockSize, size + alignment);
+        m_blocks.emplace_back(new char[blockSize]);
+        m_next = m_blocks.back().get();
+        m_left = blockSize;
+        m_nextBlockSize = blockSize * 2;
+        padding = (alignment -
+                      reinterpret_cast<std::uintptr_t>(m_next) % alignment) %
+            alignment;
+    }
+
+    auto p = m_next + padding;
+    m_next = p + size;
+    m_left -= padding + size;
+    return p;
+}
+
+ErlNifEnv *Arena::env()
+{
+    if (!m_env) {
+        m_env = enif_alloc_env();
+    }
+    return m_env;
+}
+
+ArenaPtr Arena::acquire()
+{
+    if (!current.active) {
+        return std::make_shared<Arena>();
+    }
+    if (!current.arena) {
+        current.arena = std::make_shared<Arena>();
+    }
+    return current.arena;
+}
+
+Arena::Scope::Scope()
+    : m_active{current.active}
+    , m_arena{std::move(current.arena)}
+{
+    current.active = true;
+    current.arena.reset();
+}
+
+Arena::Scope::~Scope()
+{
+    current.active = m_active;
+    current.arena = std::move(m_arena);
+}
+
+} // namespace cb
@@ -0,0 +1,139 @@
+/**
+ * @file arena.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_ARENA_H
+#define COUCHBASE_ARENA_H
+
+#include <erl_nif.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace cb {
+
+/**
+ * Monotonic memory shared by the requests of a batch. Allocations are never
+ * released one by one, all blocks are freed together when the last request
+ * referring to the arena is destroyed. The arena also owns a process
+ * independent environment to which terms of the requests are copied. It is
+ * filled by a single thread while the batch is being decoded and only read
+ * afterwards.
+ */
+class Arena {
+public:
+    Arena() = default;
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena();
+
+    void *allocate(std::size_t size, std::size_t alignment);
+
+    ErlNifEnv *env();
+
+    /**
+     * Returns the arena of the batch being decoded by the calling thread,
+     * or a new one outside of a batch.
+     */
+    static std::shared_ptr<Arena> acquire();
+
+    /**
+     * Marks the calling thread as decoding a batch, so that the arenas
+     * acquired until the scope ends are the same one.
+     */
+    class Scope {
+    public:
+        Scope();
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope();
+
+    private:
+        bool m_active;
+        std::shared_ptr<Arena> m_arena;
+    };
+
+private:
+    static constexpr std::size_t kBlockSize = 4096;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::size_t m_nextBlockSize = kBlockSize;
+    char *m_next = nullptr;
+    std::size_t m_left = 0;
+    ErlNifEnv *m_env = nullptr;
+};
+
+using ArenaPtr = std::shared_ptr<Arena>;
+
+/**
+ * Allocator drawing memory from an arena, or from the heap when it has none.
+ */
+template <typename T> class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() = default;
+
+    explicit ArenaAllocator(ArenaPtr arena)
+        : m_arena{std::move(arena)}
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other)
+        : m_arena{other.arena()}
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        if (m_arena) {
+            return static_cast<T *>(
+                m_arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t)
+    {
+        if (!m_arena) {
+            ::operator delete(p);
+        }
+    }
+
+    const ArenaPtr &arena() const { return m_arena; }
+
+private:
+    ArenaPtr m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return lhs.arena() == rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace cb
+
+#endif // COUCHBASE_ARENA_H
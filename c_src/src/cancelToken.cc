@@ -0,0 +1,28 @@
+/**
+ * @file cancelToken.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "cancelToken.h"
+
+namespace cb {
+
+bool CancelToken::cancel() { return transition(State::cancelled); }
+
+bool CancelToken::complete() { return transition(State::completed); }
+
+bool CancelToken::cancelled() const
+{
+    return m_state.load() == State::cancelled;
+}
+
+bool CancelToken::transition(State state)
+{
+    auto expected = State::pending;
+    return m_state.compare_exchange_strong(expected, state) ||
+        expected == state;
+}
+
+} // namespace cb
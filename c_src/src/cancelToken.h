@@ -0,0 +1,47 @@
+/**
+ * @file cancelToken.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_CANCEL_TOKEN_H
+#define COUCHBASE_CANCEL_TOKEN_H
+
+#include <atomic>
+#include <memory>
+
+namespace cb {
+
+/**
+ * Shared between a request and its caller, decides whether the request
+ * completes or gets cancelled. Exactly one of the two can happen, so a
+ * cancelled request is never replied to.
+ */
+class CancelToken {
+public:
+    /**
+     * Returns false if the request has already completed.
+     */
+    bool cancel();
+
+    /**
+     * Returns false if the request has already been cancelled.
+     */
+    bool complete();
+
+    bool cancelled() const;
+
+private:
+    enum class State { pending, completed, cancelled };
+
+    bool transition(State state);
+
+    std::atomic<State> m_state{State::pending};
+};
+
+using CancelTokenPtr = std::shared_ptr<CancelToken>;
+
+} // namespace cb
+
+#endif // COUCHBASE_CANCEL_TOKEN_H
@@ -7,53 +7,264 @@
 
 #include "nifpp.h"
 
+#include "cancelToken.h"
 #include "client.h"
+#include "compression.h"
 #include "connection.h"
+#include "json.h"
 #include "requests/requests.h"
 #include "responses/responses.h"
+#include "scheduler.h"
+#include "worker.h"
 
+#include <asio/post.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
-#include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace {
+std::atomic<ErlNifUInt64> nextReqId{0};
+
+ERL_NIF_TERM atomOk;
+ERL_NIF_TERM atomError;
+ERL_NIF_TERM atomOverloaded;
+ERL_NIF_TERM atomCompleted;
+ERL_NIF_TERM atomReplies;
+
+/**
+ * Replies built by a thread while its io_service handles a round of events.
+ * Replies to the same process are sent to it at the end of the round in one
+ * {cberl_replies, Replies} message, a single reply as it is. Outside of a
+ * worker thread replies are sent right away.
+ */
+class Outbox {
+public:
+    static Outbox &local()
+    {
+        thread_local Outbox outbox;
+        return outbox;
+    }
+
+    /**
+     * Returns the environment of the message to a process, in which its reply
+     * is to be built before it is added.
+     */
+    const Env &env(const ErlNifPid &pid) { return *message(pid).env; }
+
+    void add(const ErlNifPid &pid, ERL_NIF_TERM reply)
+    {
+        message(pid).replies.push_back(reply);
+        if (m_flushing) {
+            return;
+        }
+
+        auto ioService = cb::Worker::current();
+        if (!ioService) {
+            flush();
+            return;
+        }
+        m_flushing = true;
+        asio::post(*ioService, [this] { flush(); });
+    }
+
+private:
+    // Cleared environments kept for the messages of the next rounds.
+    static constexpr std::size_t kMaxSpareEnvs = 64;
+
+    struct Message {
+        ErlNifPid pid;
+        std::unique_ptr<Env> env;
+        std::vector<ERL_NIF_TERM> replies;
+    };
+
+    Message &message(const ErlNifPid &pid)
+    {
+        auto it = m_indices.find(pid.pid);
+        if (it != m_indices.end()) {
+            return m_messages[it->second];
+        }
+
+        std::unique_ptr<Env> env;
+        if (m_spareEnvs.empty()) {
+            env = std::make_unique<Env>();
+        }
+        else {
+            env = std::move(m_spareEnvs.back());
+            m_spareEnvs.pop_back();
+        }
+        m_indices.emplace(pid.pid, m_messages.size());
+        m_messages.push_back(Message{pid, std::move(env), {}});
+        return m_messages.back();
+    }
+
+    void flush()
+    {
+        for (auto &message : m_messages) {
+            auto &env = *message.env;
+            auto &replies = message.replies;
+            auto msg = replies.size() == 1
+                ? replies.front()
+                : enif_make_tuple2(env, atomReplies,
+                      enif_make_list_from_array(
+                          env, replies.data(), replies.size()));
+            enif_send(nullptr, &message.pid, env, msg);
+            env.clear();
+            if (m_spareEnvs.size() < kMaxSpareEnvs) {
+                m_spareEnvs.push_back(std::move(message.env));
+            }
+        }
+        m_messages.clear();
+        m_indices.clear();
+        m_flushing = false;
+    }
+
+    std::vector<Message> m_messages;
+    std::unordered_map<ERL_NIF_TERM, std::size_t> m_indices;
+    std::vector<std::unique_ptr<Env>> m_spareEnvs;
+    bool m_flushing = false;
+};
+
 class NifCTX {
 public:
     NifCTX(ErlNifEnv *env_, const ERL_NIF_TERM argv[])
         : reqPid{nifpp::get<ErlNifPid>(env_, argv[0])}
-        , reqId(std::make_tuple(dist(gen), dist(gen), dist(gen)))
+        , reqId{nextReqId.fetch_add(1, std::memory_order_relaxed)}
     {
     }
 
-    template <typename T> int send(T &&value) const
+    // Reply callbacks keep the context in place only if it cannot throw when
+    // moved, which the resource pointer does not declare. Its copy merely
+    // bumps the reference count.
+    NifCTX(NifCTX &&other) noexcept
+        : reqPid{other.reqPid}
+        , reqMonitor{other.reqMonitor}
+        , reqId{other.reqId}
+        , cancelToken{other.cancelToken}
     {
-        return enif_send(nullptr, &reqPid, env,
-            nifpp::make(env, std::make_tuple(reqId, std::forward<T>(value))));
     }
 
-    Env env;
-    ErlNifPid reqPid;
-    std::tuple<int, int, int> reqId;
+    /**
+     * Monitors the caller, so that the request is cancelled when it dies, and
+     * returns the token cancelling the request.
+     */
+    cb::CancelTokenPtr monitor(ErlNifEnv *env_)
+    {
+        cancelToken = nifpp::construct_resource<cb::CancelTokenPtr>(
+            std::make_shared<cb::CancelToken>());
+        if (enif_monitor_process(
+                env_, cancelToken.get(), &reqPid, &reqMonitor) != 0) {
+            (*cancelToken)->cancel();
+        }
+        return *cancelToken;
+    }
 
-private:
-    static thread_local std::random_device rd;
-    static thread_local std::default_random_engine gen;
-    static thread_local std::uniform_int_distribution<int> dist;
+    /**
+     * Sends the response to the caller through the outbox of the calling
+     * thread. The arguments are passed on to the response building the reply.
+     */
+    template <class ResponseT, typename... Args>
+    void send(const ResponseT &response, const Args &... args) const
+    {
+        if (cancelToken) {
+            enif_demonitor_process(nullptr, cancelToken.get(), &reqMonitor);
+            if (!(*cancelToken)->complete()) {
+                return;
+            }
+        }
+
+        auto &outbox = Outbox::local();
+        auto &env = outbox.env(reqPid);
+        outbox.add(reqPid,
+            enif_make_tuple2(env, enif_make_uint64(env, reqId),
+                response.toTerm(env, args...)));
+    }
+
+    /**
+     * Returns the reply telling the caller that the request was accepted.
+     */
+    ERL_NIF_TERM accepted(ErlNifEnv *env_) const
+    {
+        return enif_make_tuple3(env_, atomOk, enif_make_uint64(env_, reqId),
+            nifpp::make(env_, cancelToken));
+    }
+
+    ErlNifPid reqPid;
+    ErlNifMonitor reqMonitor;
+    ErlNifUInt64 reqId;
+    nifpp::resource_ptr<cb::CancelTokenPtr> cancelToken;
 };
 
-thread_local std::random_device NifCTX::rd{};
-thread_local std::default_random_engine NifCTX::gen{NifCTX::rd()};
-thread_local std::uniform_int_distribution<int> NifCTX::dist{};
+static_assert(cb::Callback<cb::ConnectResponse>::fits<NifCTX>(),
+    "reply callbacks are expected to keep the context in place");
+
+cb::Schedule getSchedule(ErlNifEnv *env, const cb::ClientPtr &client,
+    ERL_NIF_TERM term, cb::CancelTokenPtr cancelToken)
+{
+    auto raw = nifpp::get<std::tuple<int, nifpp::str_atom>>(env, term);
+    return {std::get<0>(raw), client->qosClass(std::get<1>(raw)),
+        std::move(cancelToken)};
+}
+
+/**
+ * Tells whether a bulk request should be decoded on a dirty CPU scheduler
+ * instead of the calling one, which would otherwise be blocked for over a
+ * millisecond by a long list. Only the first cells of the list are walked.
+ */
+bool decodeDirty(ErlNifEnv *env, ERL_NIF_TERM requests)
+{
+    constexpr std::size_t kMaxInlineRequests = 1000;
+
+    if (enif_thread_type() != ERL_NIF_THR_NORMAL_SCHEDULER) {
+        return false;
+    }
+
+    ERL_NIF_TERM head, tail = requests;
+    for (std::size_t i = 0; i < kMaxInlineRequests; ++i) {
+        if (!enif_get_list_cell(env, tail, &head, &tail)) {
+            return false;
+        }
+    }
+    return !enif_is_empty_list(env, tail);
+}
+
+void callerDown(ErlNifEnv *env, void *obj, ErlNifPid *pid, ErlNifMonitor *mon)
+{
+    (*static_cast<cb::CancelTokenPtr *>(obj))->cancel();
+}
+
+ERL_NIF_TERM overloaded(ErlNifEnv *env)
+{
+    return enif_make_tuple2(env, atomError, atomOverloaded);
+}
 } // namespace
 
 extern "C" {
 
 static int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info)
 {
+    // Request ids of a reloaded library must not repeat the ones of replies
+    // still on their way.
+    nextReqId = static_cast<ErlNifUInt64>(enif_monotonic_time(ERL_NIF_NSEC));
+
+    atomOk = enif_make_atom(env, "ok");
+    atomError = enif_make_atom(env, "error");
+    atomOverloaded = enif_make_atom(env, "overloaded");
+    atomCompleted = enif_make_atom(env, "completed");
+    atomReplies = enif_make_atom(env, "cberl_replies");
+    cb::Response::loadAtoms(env);
+    cb::json::load(env);
+
     return !(nifpp::register_resource<cb::ClientPtr>(env, nullptr, "Client") &&
         nifpp::register_resource<cb::ConnectionPtr>(
-            env, nullptr, "Connection"));
+            env, nullptr, "Connection") &&
+        nifpp::register_resource<cb::CancelTokenPtr>(
+            env, "CancelToken", callerDown) &&
+        cb::SharedBinary::registerType(env));
 }
 
 static int upgrade(
@@ -65,8 +276,33 @@ static int upgrade(
 static ERL_NIF_TERM new_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
     try {
+        auto workers = nifpp::get<unsigned int>(env, argv[0]);
         auto client = nifpp::construct_resource<cb::ClientPtr>(
-            std::make_shared<cb::Client>());
+            std::make_shared<cb::Client>(workers));
+        return nifpp::make(
+            env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(client)));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM shared_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto workers = nifpp::get<unsigned int>(env, argv[0]);
+        auto shared = cb::Client::shared(workers);
+        // The running client is resized only after its last connection is
+        // closed, so a connection asking for another size is refused.
+        if (shared->workers() != std::max(workers, 1u)) {
+            return nifpp::make(env,
+                std::make_tuple(nifpp::str_atom{"error"},
+                    std::make_tuple(nifpp::str_atom{"io_threads_mismatch"},
+                        shared->workers())));
+        }
+        auto client =
+            nifpp::construct_resource<cb::ClientPtr>(std::move(shared));
         return nifpp::make(
             env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(client)));
     }
@@ -87,15 +323,17 @@ static ERL_NIF_TERM connect_nif(
             nifpp::get<std::string>(env, argv[4]),
             nifpp::get<std::string>(env, argv[5]),
             nifpp::get<std::vector<std::tuple<nifpp::str_atom, int>>>(
-                env, argv[6])};
-
-        client->connect(
-            std::move(request), [ctx](const cb::ConnectResponse &response) {
-                ctx.send(response.toTerm(ctx.env));
+                env, argv[6]),
+            nifpp::get<std::string>(env, argv[7])};
+        auto reply = enif_make_tuple2(
+            env, atomOk, enif_make_uint64(env, ctx.reqId));
+
+        client->connect(std::move(request),
+            [ ctx = std::move(ctx) ](const cb::ConnectResponse &response) {
+                ctx.send(response);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -104,21 +342,71 @@ static ERL_NIF_TERM connect_nif(
 
 static ERL_NIF_TERM get_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "get", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            get_nif, argc, argv);
+    }
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::GetRequest> request{
-            nifpp::get<std::vector<cb::GetRequest::Raw>>(env, argv[3])};
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::GetRequest>>(env, argv[3]);
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[4], ctx.monitor(env));
+        auto safe = connection->safeDecode();
+        auto reply = ctx.accepted(env);
+
+        client->get(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx), safe ](
+                const cb::MultiResponse<cb::GetResponse> &responses) {
+                ctx.send(responses, safe);
+            });
+
+        return reply;
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM get_paths_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "get_paths",
+            ERL_NIF_DIRTY_JOB_CPU_BOUND, get_paths_nif, argc, argv);
+    }
+
+    try {
+        NifCTX ctx{env, argv};
 
-        client->get(std::move(connection), std::move(request),
-            [ctx](const cb::MultiResponse<cb::GetResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+        auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::GetRequest>>(env, argv[3]);
+        auto paths = nifpp::get<std::vector<cb::json::Path>>(env, argv[4]);
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[5], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
+
+        client->get(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx), paths = std::move(paths) ](
+                const cb::MultiResponse<cb::GetResponse> &responses) {
+                ctx.send(responses, paths);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -128,21 +416,33 @@ static ERL_NIF_TERM get_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM store_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "store", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            store_nif, argc, argv);
+    }
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::StoreRequest> request{
-            nifpp::get<std::vector<cb::StoreRequest::Raw>>(env, argv[3])};
-
-        client->store(std::move(connection), std::move(request),
-            [ctx](const cb::MultiResponse<cb::StoreResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::StoreRequest>>(env, argv[3]);
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[4], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
+
+        client->store(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx) ](
+                const cb::MultiResponse<cb::StoreResponse> &responses) {
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -152,21 +452,33 @@ static ERL_NIF_TERM store_nif(
 static ERL_NIF_TERM remove_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "remove", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            remove_nif, argc, argv);
+    }
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::RemoveRequest> request{
-            nifpp::get<std::vector<cb::RemoveRequest::Raw>>(env, argv[3])};
-
-        client->remove(std::move(connection), std::move(request),
-            [ctx](const cb::MultiResponse<cb::RemoveResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::RemoveRequest>>(env, argv[3]);
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[4], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
+
+        client->remove(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx) ](
+                const cb::MultiResponse<cb::RemoveResponse> &responses) {
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -176,21 +488,33 @@ static ERL_NIF_TERM remove_nif(
 static ERL_NIF_TERM arithmetic_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "arithmetic", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            arithmetic_nif, argc, argv);
+    }
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::ArithmeticRequest> request{
-            nifpp::get<std::vector<cb::ArithmeticRequest::Raw>>(env, argv[3])};
-
-        client->arithmetic(std::move(connection), std::move(request),
-            [ctx](const cb::MultiResponse<cb::ArithmeticResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::ArithmeticRequest>>(env, argv[3]);
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[4], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
+
+        client->arithmetic(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx) ](
+                const cb::MultiResponse<cb::ArithmeticResponse> &responses) {
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -206,14 +530,21 @@ static ERL_NIF_TERM http_nif(
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
         cb::HttpRequest request{nifpp::get<cb::HttpRequest::Raw>(env, argv[3])};
-
-        client->http(std::move(connection), std::move(request),
-            [ctx](const cb::HttpResponse &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[4], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
+
+        client->http(std::move(connection), std::move(request), schedule,
+            std::move(admission),
+            [ ctx = std::move(ctx) ](
+                const cb::HttpResponse &responses) {
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return reply;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -223,34 +554,237 @@ static ERL_NIF_TERM http_nif(
 static ERL_NIF_TERM durability_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (decodeDirty(env, argv[3])) {
+        return enif_schedule_nif(env, "durability", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            durability_nif, argc, argv);
+    }
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::DurabilityRequest> request{
-            nifpp::get<std::vector<cb::DurabilityRequest::Raw>>(env, argv[3])};
+        auto request =
+            nifpp::get<cb::MultiRequest<cb::DurabilityRequest>>(env, argv[3]);
         cb::DurabilityRequestOptions options{
             nifpp::get<cb::DurabilityRequestOptions::Raw>(env, argv[4])};
+        auto admission = connection->admit(request);
+        if (!admission) {
+            return overloaded(env);
+        }
+        auto schedule = getSchedule(env, client, argv[5], ctx.monitor(env));
+        auto reply = ctx.accepted(env);
 
         client->durability(std::move(connection), std::move(request),
-            std::move(options),
-            [ctx](const cb::MultiResponse<cb::DurabilityResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+            std::move(options), schedule, std::move(admission),
+            [ ctx = std::move(ctx) ](
+                const cb::MultiResponse<cb::DurabilityResponse> &responses) {
+                ctx.send(responses);
             });
 
+        return reply;
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM train_dictionary_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    // Training takes up to seconds for large samples.
+    if (enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER) {
+        return enif_schedule_nif(env, "train_dictionary",
+            ERL_NIF_DIRTY_JOB_CPU_BOUND, train_dictionary_nif, argc, argv);
+    }
+
+    try {
+        if (!cb::compression::available(cb::compression::Codec::zstd)) {
+            return nifpp::make(env, std::make_tuple(nifpp::str_atom{"error"},
+                                        nifpp::str_atom{"not_supported"}));
+        }
+
+        cb::Arena::Scope scope;
+        auto samples = nifpp::get<std::vector<cb::Value>>(env, argv[0]);
+        auto capacity = nifpp::get<std::size_t>(env, argv[1]);
+
+        std::vector<unsigned char> data;
+        std::vector<std::size_t> sizes;
+        sizes.reserve(samples.size());
+        for (const auto &sample : samples) {
+            sizes.push_back(sample.size());
+            for (const auto &segment : sample.segments()) {
+                auto begin =
+                    static_cast<const unsigned char *>(segment.iov_base);
+                data.insert(data.end(), begin, begin + segment.iov_len);
+            }
+        }
+
+        std::vector<unsigned char> dictionary;
+        if (!cb::compression::train(data.data(), sizes, capacity, dictionary)) {
+            return nifpp::make(env, std::make_tuple(nifpp::str_atom{"error"},
+                                        nifpp::str_atom{"training_failed"}));
+        }
+
+        ERL_NIF_TERM term;
+        std::memcpy(enif_make_new_binary(env, dictionary.size(), &term),
+            dictionary.data(), dictionary.size());
+        return enif_make_tuple2(env, atomOk, term);
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM load_dictionary_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        if (!cb::compression::available(cb::compression::Codec::zstd)) {
+            return nifpp::make(env, std::make_tuple(nifpp::str_atom{"error"},
+                                        nifpp::str_atom{"not_supported"}));
+        }
+
+        auto id = nifpp::get<unsigned int>(env, argv[0]);
+        auto dictionary = nifpp::get<ErlNifBinary>(env, argv[1]);
+        if (id == 0 || id > UINT16_MAX) {
+            return enif_make_badarg(env);
+        }
+
+        if (!cb::compression::load(static_cast<std::uint16_t>(id),
+                dictionary.data, dictionary.size)) {
+            return nifpp::make(env, std::make_tuple(nifpp::str_atom{"error"},
+                                        nifpp::str_atom{"invalid_dictionary"}));
+        }
+        return atomOk;
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM unload_dictionary_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto id = nifpp::get<unsigned int>(env, argv[0]);
+        if (id == 0 || id > UINT16_MAX) {
+            return enif_make_badarg(env);
+        }
+
+        cb::compression::unload(static_cast<std::uint16_t>(id));
+        return atomOk;
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        auto stats = connection->stats();
+        std::vector<std::tuple<nifpp::str_atom, std::size_t>> values{
+            std::make_tuple(nifpp::str_atom{"inflight_ops"}, stats.inflightOps),
+            std::make_tuple(
+                nifpp::str_atom{"inflight_bytes"}, stats.inflightBytes),
+            std::make_tuple(
+                nifpp::str_atom{"max_inflight_ops"}, stats.maxInflightOps),
+            std::make_tuple(
+                nifpp::str_atom{"max_inflight_bytes"}, stats.maxInflightBytes),
+            std::make_tuple(nifpp::str_atom{"rejected"}, stats.rejected)};
+
         return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+            env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(values)));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM inflight_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        return nifpp::make(env, connection->stats().inflightOps);
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM configure_class_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto client = nifpp::get<cb::ClientPtr>(env, argv[0]);
+        client->configureQosClass(nifpp::get<nifpp::str_atom>(env, argv[1]),
+            nifpp::get<int>(env, argv[2]),
+            nifpp::get<unsigned int>(env, argv[3]),
+            nifpp::get<unsigned int>(env, argv[4]),
+            nifpp::get<unsigned int>(env, argv[5]));
+
+        return nifpp::make(env, nifpp::str_atom{"ok"});
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM class_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto client = nifpp::get<cb::ClientPtr>(env, argv[0]);
+        std::vector<nifpp::TERM> classes;
+        for (const auto &qosClass : client->qosClasses()) {
+            auto stats = qosClass->stats();
+            std::vector<std::tuple<nifpp::str_atom, std::size_t>> values{
+                std::make_tuple(nifpp::str_atom{"queued"}, stats.queued),
+                std::make_tuple(nifpp::str_atom{"scheduled"}, stats.scheduled),
+                std::make_tuple(
+                    nifpp::str_atom{"throttled"}, stats.throttled),
+                std::make_tuple(nifpp::str_atom{"dropped"}, stats.dropped)};
+            classes.emplace_back(nifpp::make(env,
+                std::make_tuple(
+                    nifpp::str_atom{qosClass->name()}, std::move(values))));
+        }
+
+        return nifpp::make(
+            env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(classes)));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM cancel_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto cancelToken = nifpp::get<cb::CancelTokenPtr>(env, argv[0]);
+        return cancelToken->cancel() ? atomOk : atomCompleted;
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
     }
 }
 
-static ErlNifFunc nif_funcs[] = {{"new", 0, new_nif},
-    {"connect", 7, connect_nif}, {"get", 4, get_nif}, {"store", 4, store_nif},
-    {"remove", 4, remove_nif}, {"arithmetic", 4, arithmetic_nif},
-    {"http", 4, http_nif}, {"durability", 5, durability_nif}};
+static ErlNifFunc nif_funcs[] = {{"new", 1, new_nif},
+    {"shared", 1, shared_nif}, {"connect", 8, connect_nif},
+    {"get", 5, get_nif}, {"get_paths", 6, get_paths_nif},
+    {"store", 5, store_nif},
+    {"remove", 5, remove_nif}, {"arithmetic", 5, arithmetic_nif},
+    {"http", 5, http_nif}, {"durability", 6, durability_nif},
+    {"train_dictionary", 2, train_dictionary_nif},
+    {"load_dictionary", 2, load_dictionary_nif},
+    {"unload_dictionary", 1, unload_dictionary_nif},
+    {"stats", 1, stats_nif}, {"inflight", 1, inflight_nif},
+    {"configure_class", 6, configure_class_nif},
+    {"class_stats", 1, class_stats_nif}, {"cancel", 1, cancel_nif}};
 
 ERL_NIF_INIT(cberl_nif, nif_funcs, load, NULL, upgrade, NULL)
 }
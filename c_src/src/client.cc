@@ -7,93 +7,252 @@
 
 #include "client.h"
 #include "connection.h"
+#include "shard.h"
 
 #include <asio/post.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+
+namespace {
+struct Bootstrap {
+    std::mutex mutex;
+    std::vector<cb::ShardPtr> shards;
+    std::size_t pending;
+    lcb_error_t err;
+    std::function<void(std::vector<cb::ShardPtr>)> onSuccess;
+    std::function<void(lcb_error_t)> onError;
+
+    void complete(std::size_t i, cb::ShardPtr shard, lcb_error_t shardErr)
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        shards[i] = std::move(shard);
+        if (shardErr != LCB_SUCCESS) {
+            err = shardErr;
+        }
+        if (--pending > 0) {
+            return;
+        }
+        lock.unlock();
+
+        if (err != LCB_SUCCESS) {
+            shards.clear();
+            onError(err);
+        }
+        else {
+            onSuccess(std::move(shards));
+        }
+    }
+};
+
+/**
+ * Bootstraps of a shard from different seed hosts, the first to succeed
+ * wins. All of them run on the io_service of the shard.
+ */
+struct Race {
+    std::size_t pending;
+    bool done = false;
+    lcb_error_t err = LCB_SUCCESS;
+    std::function<void(cb::ShardPtr, lcb_error_t)> onComplete;
+
+    void complete(cb::ShardPtr shard, lcb_error_t shardErr)
+    {
+        --pending;
+        if (done) {
+            return;
+        }
+        if (shardErr == LCB_SUCCESS) {
+            done = true;
+            onComplete(std::move(shard), LCB_SUCCESS);
+            return;
+        }
+        err = shardErr;
+        if (pending == 0) {
+            done = true;
+            onComplete(nullptr, err);
+        }
+    }
+};
+
+std::vector<std::string> seeds(
+    const cb::ConnectRequest &request, const std::string &configCache)
+{
+    // A cached cluster map bootstraps the instance without a round trip to
+    // the cluster, so there is nothing to gain from racing the seeds.
+    auto seeds = request.seeds();
+    if (seeds.size() < 2 ||
+        (!configCache.empty() && std::ifstream{configCache}.good())) {
+        return {request.host()};
+    }
+    return seeds;
+}
+} // namespace
+
 namespace cb {
 
-Client::Client()
-    : m_ioService{1}
-    , m_work{asio::make_work_guard(m_ioService)}
-    , m_worker{[=] { m_ioService.run(); }}
+Client::Client(std::size_t workers)
 {
+    for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); ++i) {
+        m_workers.emplace_back(std::make_unique<Worker>());
+    }
+    m_qosClasses.emplace(
+        "interactive", std::make_shared<QosClass>("interactive", 0));
+    m_qosClasses.emplace("batch", std::make_shared<QosClass>("batch", 1));
 }
 
-Client::~Client()
+ClientPtr Client::shared(std::size_t workers)
 {
-    m_ioService.stop();
-    m_worker.join();
+    static std::mutex mutex;
+    static std::weak_ptr<Client> shared;
+
+    std::lock_guard<std::mutex> guard{mutex};
+    auto client = shared.lock();
+    if (!client) {
+        client = std::make_shared<Client>(workers);
+        shared = client;
+    }
+    return client;
+}
+
+std::size_t Client::workers() const { return m_workers.size(); }
+
+QosClassPtr Client::qosClass(const std::string &name)
+{
+    std::lock_guard<std::mutex> guard{m_qosClassesMutex};
+    auto it = m_qosClasses.find(name);
+    if (it == m_qosClasses.end()) {
+        return m_qosClasses.at("interactive");
+    }
+    return it->second;
+}
+
+void Client::configureQosClass(const std::string &name, int priority,
+    std::size_t weight, std::size_t opsPerSec, std::size_t bytesPerSec)
+{
+    std::lock_guard<std::mutex> guard{m_qosClassesMutex};
+    auto &qosClass = m_qosClasses[name];
+    if (!qosClass) {
+        qosClass = std::make_shared<QosClass>(name);
+    }
+    qosClass->configure(priority, weight, opsPerSec, bytesPerSec);
+}
+
+std::vector<QosClassPtr> Client::qosClasses()
+{
+    std::lock_guard<std::mutex> guard{m_qosClassesMutex};
+    std::vector<QosClassPtr> qosClasses;
+    for (const auto &entry : m_qosClasses) {
+        qosClasses.emplace_back(entry.second);
+    }
+    return qosClasses;
 }
 
 void Client::connect(ConnectRequest request, Callback<ConnectResponse> callback)
 {
-    asio::post(m_ioService,
-        [ request = std::move(request), callback = std::move(callback) ] {
-            try {
-                auto connection = std::make_shared<Connection>(request);
-                callback(ConnectResponse{LCB_SUCCESS, std::move(connection)});
-            }
-            catch (lcb_error_t err) {
-                callback(ConnectResponse{err, nullptr});
+    auto size = request.shards();
+    auto bootstrap = std::make_shared<Bootstrap>();
+    bootstrap->shards.resize(size);
+    bootstrap->pending = size;
+    bootstrap->err = LCB_SUCCESS;
+    // Both outcomes share the callback, which cannot be copied.
+    auto sharedCallback =
+        std::make_shared<Callback<ConnectResponse>>(std::move(callback));
+    bootstrap->onSuccess = [
+        self = shared_from_this(), callback = sharedCallback,
+        maxInflightOps = request.maxInflightOps(),
+        maxInflightBytes = request.maxInflightBytes(),
+        safeDecode = request.safeDecode()
+    ](std::vector<ShardPtr> shards) {
+        (*callback)(ConnectResponse{LCB_SUCCESS,
+            std::make_shared<Connection>(self, std::move(shards),
+                maxInflightOps, maxInflightBytes, safeDecode)});
+    };
+    bootstrap->onError = [callback = sharedCallback](lcb_error_t err) {
+        (*callback)(ConnectResponse{err, nullptr});
+    };
+
+    auto sharedRequest = std::make_shared<ConnectRequest>(std::move(request));
+
+    for (std::size_t i = 0; i < size; ++i) {
+        auto &ioService =
+            m_workers[m_nextWorker++ % m_workers.size()]->ioService();
+        asio::post(ioService, [
+            &ioService, i, bootstrap, request = sharedRequest
+        ] {
+            auto configCache = request->configCache(i);
+            auto hosts = seeds(*request, configCache);
+            auto race = std::make_shared<Race>();
+            race->pending = hosts.size();
+            race->onComplete = [i, bootstrap](ShardPtr shard, lcb_error_t err) {
+                bootstrap->complete(i, std::move(shard), err);
+            };
+
+            for (const auto &host : hosts) {
+                ShardPtr shard;
+                try {
+                    shard =
+                        Shard::create(*request, host, configCache, ioService);
+                }
+                catch (lcb_error_t err) {
+                    race->complete(nullptr, err);
+                    continue;
+                }
+
+                shard->bootstrap([race, shard](lcb_error_t err) {
+                    race->complete(shard, err);
+                });
             }
         });
+    }
 }
 
 void Client::get(ConnectionPtr connection, MultiRequest<GetRequest> request,
+    Schedule schedule, Admission admission,
     Callback<MultiResponse<GetResponse>> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { callback(connection->get(request)); });
+    connection->get(std::move(request), schedule, std::move(admission),
+        std::move(callback));
 }
 
-void Client::store(ConnectionPtr connection, MultiRequest<StoreRequest> request,
-    Callback<MultiResponse<StoreResponse>> callback)
+void Client::store(ConnectionPtr connection,
+    MultiRequest<StoreRequest> request, Schedule schedule,
+    Admission admission, Callback<MultiResponse<StoreResponse>> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { callback(connection->store(request)); });
+    connection->store(std::move(request), schedule, std::move(admission),
+        std::move(callback));
 }
 
 void Client::remove(ConnectionPtr connection,
-    MultiRequest<RemoveRequest> request,
-    Callback<MultiResponse<RemoveResponse>> callback)
+    MultiRequest<RemoveRequest> request, Schedule schedule,
+    Admission admission, Callback<MultiResponse<RemoveResponse>> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { callback(connection->remove(request)); });
+    connection->remove(std::move(request), schedule, std::move(admission),
+        std::move(callback));
 }
 
 void Client::arithmetic(ConnectionPtr connection,
-    MultiRequest<ArithmeticRequest> request,
-    Callback<MultiResponse<ArithmeticResponse>> callback)
+    MultiRequest<ArithmeticRequest> request, Schedule schedule,
+    Admission admission, Callback<MultiResponse<ArithmeticResponse>> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { callback(connection->arithmetic(request)); });
+    connection->arithmetic(std::move(request), schedule,
+        std::move(admission), std::move(callback));
 }
 
 void Client::http(ConnectionPtr connection, HttpRequest request,
-    Callback<HttpResponse> callback)
+    Schedule schedule, Admission admission, Callback<HttpResponse> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { callback(connection->http(request)); });
+    connection->http(std::move(request), schedule, std::move(admission),
+        std::move(callback));
 }
 
 void Client::durability(ConnectionPtr connection,
     MultiRequest<DurabilityRequest> request, DurabilityRequestOptions options,
+    Schedule schedule, Admission admission,
     Callback<MultiResponse<DurabilityResponse>> callback)
 {
-    asio::post(m_ioService, [
-        connection = std::move(connection), request = std::move(request),
-        options = std::move(options), callback = std::move(callback)
-    ] { callback(connection->durability(request, options)); });
+    connection->durability(std::move(request), std::move(options), schedule,
+        std::move(admission), std::move(callback));
 }
 
 } // namespace cb
@@ -8,57 +8,86 @@
 #ifndef COUCHBASE_CLIENT_H
 #define COUCHBASE_CLIENT_H
 
+#include "connection.h"
+#include "qosClass.h"
 #include "requests/requests.h"
 #include "responses/responses.h"
+#include "scheduler.h"
 #include "types.h"
+#include "worker.h"
 
-#include <asio/executor_work_guard.hpp>
-#include <asio/io_service.hpp>
 #include <libcouchbase/couchbase.h>
 
-#include <functional>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace cb {
 
-class Client {
-    template <typename T> using Callback = std::function<void(const T &)>;
-
+/**
+ * Pool of worker threads shared by connections. Besides private clients, a
+ * node-wide client is shared by connections that do not ask for dedicated
+ * workers and lives as long as any of them.
+ */
+class Client : public std::enable_shared_from_this<Client> {
 public:
-    Client();
+    Client(std::size_t workers);
+
+    /**
+     * Returns the node-wide client, starting it with the given number of
+     * workers if it is not running. A running client keeps the number of
+     * workers it was started with, so the caller has to compare it with the
+     * requested one.
+     */
+    static ClientPtr shared(std::size_t workers);
+
+    std::size_t workers() const;
+
+    QosClassPtr qosClass(const std::string &name);
+
+    void configureQosClass(const std::string &name, int priority,
+        std::size_t weight, std::size_t opsPerSec, std::size_t bytesPerSec);
 
-    ~Client();
+    std::vector<QosClassPtr> qosClasses();
 
     void connect(ConnectRequest, Callback<ConnectResponse> callback);
 
     void get(ConnectionPtr connection, MultiRequest<GetRequest> request,
+        Schedule schedule, Admission admission,
         Callback<MultiResponse<GetResponse>> callback);
 
     void store(ConnectionPtr connection, MultiRequest<StoreRequest> request,
+        Schedule schedule, Admission admission,
         Callback<MultiResponse<StoreResponse>> callback);
 
-    void remove(ConnectionPtr connection, MultiRequest<RemoveRequest> request,
+    void remove(ConnectionPtr connection,
+        MultiRequest<RemoveRequest> request, Schedule schedule,
+        Admission admission,
         Callback<MultiResponse<RemoveResponse>> callback);
 
     void arithmetic(ConnectionPtr connection,
-        MultiRequest<ArithmeticRequest> request,
+        MultiRequest<ArithmeticRequest> request, Schedule schedule,
+        Admission admission,
         Callback<MultiResponse<ArithmeticResponse>> callback);
 
     void http(ConnectionPtr connection, HttpRequest request,
+        Schedule schedule, Admission admission,
         Callback<HttpResponse> callback);
 
     void durability(ConnectionPtr connection,
         MultiRequest<DurabilityRequest> request,
-        DurabilityRequestOptions options,
+        DurabilityRequestOptions options, Schedule schedule,
+        Admission admission,
         Callback<MultiResponse<DurabilityResponse>> callback);
 
 private:
-    asio::io_service m_ioService;
-    asio::executor_work_guard<asio::io_service::executor_type> m_work;
-    std::thread m_worker;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<std::size_t> m_nextWorker{0};
+    std::mutex m_qosClassesMutex;
+    std::unordered_map<std::string, QosClassPtr> m_qosClasses;
 };
 
 } // namespace cb
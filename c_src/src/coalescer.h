@@ -0,0 +1,130 @@
+/**
+ * @file coalescer.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_COALESCER_H
+#define COUCHBASE_COALESCER_H
+
+#include "requests/multiRequest.h"
+#include "responses/multiResponse.h"
+#include "types.h"
+
+#include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cb {
+
+/**
+ * Collects single-key requests that arrive within a time window into one
+ * bulk request and hands each caller the response for its own key. It must
+ * be used from the thread running the io_service.
+ */
+template <class RequestT, class ResponseT> class Coalescer {
+public:
+    using Flush = std::function<void(const MultiRequest<RequestT> &,
+        TrackedCallback<MultiResponse<ResponseT>>)>;
+
+    Coalescer(asio::io_service &ioService, std::chrono::microseconds window,
+        std::size_t size, Flush flush)
+        : m_timer{ioService}
+        , m_window{window}
+        , m_size{size}
+        , m_flush{std::move(flush)}
+    {
+    }
+
+    void add(
+        RequestT request, TrackedCallback<MultiResponse<ResponseT>> callback)
+    {
+        m_callbacks.emplace_back(request.key(), std::move(callback));
+        m_request.add(std::move(request));
+
+        if (m_callbacks.size() >= m_size) {
+            flush();
+        }
+        else if (m_callbacks.size() == 1) {
+            m_timer.expires_after(m_window);
+            m_timer.async_wait([this](const asio::error_code &ec) {
+                if (!ec) {
+                    flush();
+                }
+            });
+        }
+    }
+
+    void flush()
+    {
+        if (m_callbacks.empty()) {
+            return;
+        }
+
+        asio::error_code ec;
+        m_timer.cancel(ec);
+
+        auto callbacks = std::make_shared<Callbacks>(std::move(m_callbacks));
+        auto request = std::move(m_request);
+        m_callbacks.clear();
+        m_request = MultiRequest<RequestT>{};
+
+        m_flush(request, [callbacks](const MultiResponse<ResponseT> &response) {
+            scatter(*callbacks, response);
+        });
+    }
+
+private:
+    using Callbacks = std::vector<
+        std::pair<std::string, TrackedCallback<MultiResponse<ResponseT>>>>;
+
+    static void scatter(
+        Callbacks &callbacks, const MultiResponse<ResponseT> &response)
+    {
+        if (response.err() != LCB_SUCCESS) {
+            for (auto &callback : callbacks) {
+                callback.second(response);
+            }
+            return;
+        }
+
+        // The same key may be requested by many callers, so responses are
+        // handed out in the order the requests were added.
+        std::unordered_map<std::string, std::deque<const ResponseT *>> byKey;
+        for (const auto &keyResponse : response.responses()) {
+            byKey[keyResponse.key()].push_back(&keyResponse);
+        }
+
+        for (auto &callback : callbacks) {
+            auto &responses = byKey[callback.first];
+            if (responses.empty()) {
+                callback.second(MultiResponse<ResponseT>{LCB_EINTERNAL});
+                continue;
+            }
+            MultiResponse<ResponseT> single{LCB_SUCCESS};
+            single.add(*responses.front());
+            responses.pop_front();
+            callback.second(single);
+        }
+    }
+
+    asio::steady_timer m_timer;
+    std::chrono::microseconds m_window;
+    std::size_t m_size;
+    Flush m_flush;
+    MultiRequest<RequestT> m_request;
+    Callbacks m_callbacks;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_COALESCER_H
@@ -0,0 +1,353 @@
+/**
+ * @file compression.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "compression.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef WITH_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace {
+#if defined(WITH_LZ4) || defined(WITH_ZSTD)
+// Values of Couchbase are limited to 20 MiB, so anything claiming to expand
+// beyond that is corrupt.
+constexpr std::size_t kMaxValueSize = 20 * 1024 * 1024;
+
+/**
+ * Returns the value as one contiguous block, copying its segments to the
+ * buffer only if there is more than one.
+ */
+const unsigned char *contiguous(const lcb_IOV *segments, std::size_t count,
+    std::size_t &size, cb::compression::Buffer &buffer)
+{
+    if (count == 1) {
+        size = segments[0].iov_len;
+        return static_cast<const unsigned char *>(segments[0].iov_base);
+    }
+
+    size = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        size += segments[i].iov_len;
+    }
+    buffer.resize(size);
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::memcpy(buffer.data() + offset, segments[i].iov_base,
+            segments[i].iov_len);
+        offset += segments[i].iov_len;
+    }
+    return buffer.data();
+}
+#endif
+
+#ifdef WITH_LZ4
+// LZ4 blocks do not record the size of their data, so it precedes them as a
+// 32-bit little-endian integer.
+constexpr std::size_t kLz4Header = 4;
+
+bool compressLz4(const lcb_IOV *segments, std::size_t count,
+    cb::compression::Buffer &out)
+{
+    cb::compression::Buffer flat{0};
+    std::size_t size;
+    auto data = contiguous(segments, count, size, flat);
+    auto bound = LZ4_compressBound(static_cast<int>(size));
+    if (size > kMaxValueSize || bound <= 0) {
+        return false;
+    }
+
+    out.resize(kLz4Header + bound);
+    for (std::size_t i = 0; i < kLz4Header; ++i) {
+        out[i] = static_cast<unsigned char>(size >> (8 * i));
+    }
+    auto written = LZ4_compress_default(reinterpret_cast<const char *>(data),
+        reinterpret_cast<char *>(out.data() + kLz4Header),
+        static_cast<int>(size), bound);
+    if (written <= 0) {
+        return false;
+    }
+    out.resize(kLz4Header + written);
+    return true;
+}
+
+bool decompressLz4(
+    const unsigned char *data, std::size_t size, cb::compression::Buffer &out)
+{
+    if (size < kLz4Header) {
+        return false;
+    }
+
+    std::size_t original = 0;
+    for (std::size_t i = 0; i < kLz4Header; ++i) {
+        original |= static_cast<std::size_t>(data[i]) << (8 * i);
+    }
+    if (original > kMaxValueSize) {
+        return false;
+    }
+
+    out.resize(original);
+    auto read = LZ4_decompress_safe(
+        reinterpret_cast<const char *>(data + kLz4Header),
+        reinterpret_cast<char *>(out.data()),
+        static_cast<int>(size - kLz4Header), static_cast<int>(original));
+    return read >= 0 && static_cast<std::size_t>(read) == original;
+}
+#endif
+
+#ifdef WITH_ZSTD
+constexpr int kZstdLevel = 3;
+
+ZSTD_CCtx *compressionContext()
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context{
+        ZSTD_createCCtx(), &ZSTD_freeCCtx};
+    return context.get();
+}
+
+ZSTD_DCtx *decompressionContext()
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context{
+        ZSTD_createDCtx(), &ZSTD_freeDCtx};
+    return context.get();
+}
+
+/**
+ * Dictionary digested for compression and decompression, which is done once
+ * when it is loaded instead of for every value.
+ */
+class Dictionary {
+public:
+    Dictionary(const unsigned char *data, std::size_t size)
+        : m_compression{ZSTD_createCDict(data, size, kZstdLevel),
+              &ZSTD_freeCDict}
+        , m_decompression{ZSTD_createDDict(data, size), &ZSTD_freeDDict}
+    {
+    }
+
+    bool valid() const { return m_compression && m_decompression; }
+
+    const ZSTD_CDict *compression() const { return m_compression.get(); }
+
+    const ZSTD_DDict *decompression() const { return m_decompression.get(); }
+
+private:
+    std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)> m_compression;
+    std::unique_ptr<ZSTD_DDict, decltype(&ZSTD_freeDDict)> m_decompression;
+};
+
+using DictionaryPtr = std::shared_ptr<const Dictionary>;
+
+std::mutex dictionariesMutex;
+std::unordered_map<std::uint16_t, DictionaryPtr> dictionaries;
+
+DictionaryPtr dictionary(std::uint16_t id)
+{
+    std::lock_guard<std::mutex> guard{dictionariesMutex};
+    auto it = dictionaries.find(id);
+    return it != dictionaries.end() ? it->second : nullptr;
+}
+
+bool compressZstd(const Dictionary *dictionary, const lcb_IOV *segments,
+    std::size_t count, cb::compression::Buffer &out)
+{
+    cb::compression::Buffer flat{0};
+    std::size_t size;
+    auto data = contiguous(segments, count, size, flat);
+    out.resize(ZSTD_compressBound(size));
+    auto written = dictionary
+        ? ZSTD_compress_usingCDict(compressionContext(), out.data(),
+              out.size(), data, size, dictionary->compression())
+        : ZSTD_compressCCtx(compressionContext(), out.data(), out.size(),
+              data, size, kZstdLevel);
+    if (ZSTD_isError(written)) {
+        return false;
+    }
+    out.resize(written);
+    return true;
+}
+
+bool decompressZstd(const Dictionary *dictionary, const unsigned char *data,
+    std::size_t size, cb::compression::Buffer &out)
+{
+    // Frames record the size of their data, which is checked before any
+    // memory is allocated for it.
+    auto original = ZSTD_getFrameContentSize(data, size);
+    if (original == ZSTD_CONTENTSIZE_ERROR ||
+        original == ZSTD_CONTENTSIZE_UNKNOWN || original > kMaxValueSize) {
+        return false;
+    }
+
+    out.resize(original);
+    auto read = dictionary
+        ? ZSTD_decompress_usingDDict(decompressionContext(), out.data(),
+              out.size(), data, size, dictionary->decompression())
+        : ZSTD_decompressDCtx(
+              decompressionContext(), out.data(), out.size(), data, size);
+    return !ZSTD_isError(read) && read == original;
+}
+#endif
+} // namespace
+
+namespace cb {
+namespace compression {
+
+bool available(Codec codec)
+{
+    switch (codec) {
+        case Codec::none:
+            return true;
+#ifdef WITH_LZ4
+        case Codec::lz4:
+            return true;
+#endif
+#ifdef WITH_ZSTD
+        case Codec::zstd:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool compress(const Method &method, const lcb_IOV *segments,
+    std::size_t count, Buffer &buffer)
+{
+    switch (method.codec) {
+#ifdef WITH_LZ4
+        case Codec::lz4:
+            return method.dictionary == 0 &&
+                compressLz4(segments, count, buffer);
+#endif
+#ifdef WITH_ZSTD
+        case Codec::zstd: {
+            if (method.dictionary == 0) {
+                return compressZstd(nullptr, segments, count, buffer);
+            }
+            auto found = dictionary(method.dictionary);
+            return found && compressZstd(found.get(), segments, count, buffer);
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool decompress(const Method &method, const unsigned char *data,
+    std::size_t size, Buffer &buffer)
+{
+    switch (method.codec) {
+#ifdef WITH_LZ4
+        case Codec::lz4:
+            return method.dictionary == 0 &&
+                decompressLz4(data, size, buffer);
+#endif
+#ifdef WITH_ZSTD
+        case Codec::zstd: {
+            if (method.dictionary == 0) {
+                return decompressZstd(nullptr, data, size, buffer);
+            }
+            auto found = dictionary(method.dictionary);
+            return found && decompressZstd(found.get(), data, size, buffer);
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool train(const unsigned char *samples, const std::vector<std::size_t> &sizes,
+    std::size_t capacity, std::vector<unsigned char> &dictionary)
+{
+#ifdef WITH_ZSTD
+    dictionary.resize(capacity);
+    auto size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+        samples, sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        return false;
+    }
+    dictionary.resize(size);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool load(std::uint16_t id, const unsigned char *data, std::size_t size)
+{
+#ifdef WITH_ZSTD
+    auto digested = std::make_shared<const Dictionary>(data, size);
+    if (id == 0 || !digested->valid()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard{dictionariesMutex};
+    dictionaries[id] = std::move(digested);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void unload(std::uint16_t id)
+{
+#ifdef WITH_ZSTD
+    std::lock_guard<std::mutex> guard{dictionariesMutex};
+    dictionaries.erase(id);
+#endif
+}
+
+bool loaded(std::uint16_t id)
+{
+#ifdef WITH_ZSTD
+    return dictionary(id) != nullptr;
+#else
+    return false;
+#endif
+}
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, Method &var)
+{
+    // Dictionaries are given as {zstd, Id}, as only zstd makes use of them.
+    int arity;
+    const ERL_NIF_TERM *elements;
+    unsigned int id = 0;
+    if (enif_get_tuple(env, term, &arity, &elements)) {
+        if (arity != 2 || !enif_get_uint(env, elements[1], &id) || id == 0 ||
+            id > UINT16_MAX) {
+            return 0;
+        }
+        term = elements[0];
+    }
+
+    char name[8];
+    if (!enif_get_atom(env, term, name, sizeof(name), ERL_NIF_LATIN1)) {
+        return 0;
+    }
+    if (std::strcmp(name, "lz4") == 0 && id == 0) {
+        var.codec = Codec::lz4;
+    }
+    else if (std::strcmp(name, "zstd") == 0) {
+        var.codec = Codec::zstd;
+    }
+    else {
+        return 0;
+    }
+    var.dictionary = static_cast<std::uint16_t>(id);
+    return 1;
+}
+
+} // namespace compression
+} // namespace cb
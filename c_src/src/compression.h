@@ -0,0 +1,112 @@
+/**
+ * @file compression.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_COMPRESSION_H
+#define COUCHBASE_COMPRESSION_H
+
+#include "threadBuffer.h"
+
+#include <erl_nif.h>
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cb {
+namespace compression {
+
+/**
+ * Codec of a stored value. It is recorded in the item flags above the bits
+ * of the value format, so that any reader knows how to decompress the value.
+ */
+enum class Codec : lcb_uint32_t { none = 0, lz4 = 1, zstd = 2 };
+
+/**
+ * Codec of a value along with the id of the zstd dictionary it is compressed
+ * with, where 0 stands for no dictionary. The id is recorded in the item
+ * flags above the codec.
+ */
+struct Method {
+    Codec codec = Codec::none;
+    std::uint16_t dictionary = 0;
+};
+
+constexpr lcb_uint32_t kFormatMask = 0xffu;
+constexpr lcb_uint32_t kCodecShift = 8;
+constexpr lcb_uint32_t kCodecMask = 0xffu << kCodecShift;
+constexpr lcb_uint32_t kDictionaryShift = 16;
+
+using Buffer = ThreadBuffer<unsigned char>;
+
+inline Method method(lcb_uint32_t flags)
+{
+    return {static_cast<Codec>((flags & kCodecMask) >> kCodecShift),
+        static_cast<std::uint16_t>(flags >> kDictionaryShift)};
+}
+
+inline lcb_uint32_t format(lcb_uint32_t flags) { return flags & kFormatMask; }
+
+inline lcb_uint32_t withMethod(lcb_uint32_t flags, const Method &method)
+{
+    return format(flags) |
+        (static_cast<lcb_uint32_t>(method.codec) << kCodecShift) |
+        (static_cast<lcb_uint32_t>(method.dictionary) << kDictionaryShift);
+}
+
+/**
+ * Tells whether the library has been built with a codec.
+ */
+bool available(Codec codec);
+
+/**
+ * Compresses the concatenation of the segments of a value to the buffer.
+ * Returns false if the dictionary of the method has not been loaded.
+ */
+bool compress(const Method &method, const lcb_IOV *segments,
+    std::size_t count, Buffer &buffer);
+
+/**
+ * Decompresses a value to the buffer. Returns false if the codec is not
+ * available, the dictionary has not been loaded or the data is corrupt.
+ */
+bool decompress(const Method &method, const unsigned char *data,
+    std::size_t size, Buffer &buffer);
+
+/**
+ * Trains a zstd dictionary of at most capacity bytes on samples given as
+ * their concatenation and sizes. Samples should be values of the kind the
+ * dictionary is meant for, as the dictionary is only useful for values with
+ * content in common with them.
+ */
+bool train(const unsigned char *samples, const std::vector<std::size_t> &sizes,
+    std::size_t capacity, std::vector<unsigned char> &dictionary);
+
+/**
+ * Loads a dictionary, so that values can be compressed and decompressed with
+ * it under the id. Dictionaries stay loaded until they are unloaded and
+ * loading another one under the same id replaces it.
+ */
+bool load(std::uint16_t id, const unsigned char *data, std::size_t size);
+
+/**
+ * Unloads the dictionary loaded under the id, if any. Values being compressed
+ * or decompressed with it keep it until they are done.
+ */
+void unload(std::uint16_t id);
+
+/**
+ * Tells whether a dictionary has been loaded under the id.
+ */
+bool loaded(std::uint16_t id);
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, Method &var);
+
+} // namespace compression
+} // namespace cb
+
+#endif // COUCHBASE_COMPRESSION_H
@@ -6,362 +6,420 @@
  */
 
 #include "connection.h"
+#include "shard.h"
+
+#include <asio/post.hpp>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 
 namespace {
-void getCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_get_resp_t *resp)
+std::uint32_t crc32(const std::string &data)
 {
-    auto response = const_cast<cb::MultiResponse<cb::GetResponse> *>(
-        static_cast<const cb::MultiResponse<cb::GetResponse> *>(cookie));
-    if (err == LCB_SUCCESS) {
-        response->add(
-            cb::GetResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas,
-                resp->v.v0.flags, resp->v.v0.bytes, resp->v.v0.nbytes});
-    }
-    else {
-        response->add(cb::GetResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> values{};
+        for (std::uint32_t i = 0; i < values.size(); ++i) {
+            std::uint32_t value = i;
+            for (int j = 0; j < 8; ++j) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            values[i] = value;
+        }
+        return values;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (unsigned char c : data) {
+        crc = table[(crc ^ c) & 0xFF] ^ (crc >> 8);
     }
+    return crc ^ 0xFFFFFFFFu;
 }
 
-void storeCallback(lcb_t instance, const void *cookie, lcb_storage_t operation,
-    lcb_error_t err, const lcb_store_resp_t *resp)
+template <class RequestT>
+cb::Scheduler::Keys keys(
+    const cb::ShardPtr &shard, const cb::MultiRequest<RequestT> &request)
 {
-    auto response = const_cast<cb::MultiResponse<cb::StoreResponse> *>(
-        static_cast<const cb::MultiResponse<cb::StoreResponse> *>(cookie));
-    if (err == LCB_SUCCESS) {
-        response->add(
-            cb::StoreResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
-    }
-    else {
-        response->add(cb::StoreResponse{err, resp->v.v0.key, resp->v.v0.nkey});
-    }
+    // Shards of all connections on a worker share its scheduler.
+    auto salt = std::hash<const cb::Shard *>{}(shard.get());
+    cb::Scheduler::Keys values;
+    values.reserve(request.requests().size());
+    for (const auto &part : request.requests()) {
+        values.push_back(std::hash<std::string>{}(part.key()) ^ salt);
+    }
+    return values;
 }
 
-void arithmeticCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_arithmetic_resp_t *resp)
+cb::Scheduler::Keys keys(const cb::ShardPtr &, const cb::HttpRequest &)
 {
-    auto response = const_cast<cb::MultiResponse<cb::ArithmeticResponse> *>(
-        static_cast<const cb::MultiResponse<cb::ArithmeticResponse> *>(cookie));
-    if (err == LCB_SUCCESS) {
-        response->add(cb::ArithmeticResponse{
-            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas, resp->v.v0.value});
-    }
-    else {
-        response->add(
-            cb::ArithmeticResponse{err, resp->v.v0.key, resp->v.v0.nkey});
-    }
+    return {};
 }
 
-void removeCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_remove_resp_t *resp)
+template <class RequestT, class ResponseT, typename F>
+void post(const cb::ShardPtr &shard, const cb::Schedule &schedule,
+    std::size_t ops, std::size_t bytes, RequestT request,
+    cb::TrackedCallback<ResponseT> callback, F method)
 {
-    auto response = const_cast<cb::MultiResponse<cb::RemoveResponse> *>(
-        static_cast<const cb::MultiResponse<cb::RemoveResponse> *>(cookie));
-    response->add(cb::RemoveResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    auto requestKeys = keys(shard, request);
+    auto task = [
+        shard, request = std::move(request), callback = std::move(callback),
+        method
+    ](lcb_error_t err) mutable
+    {
+        if (err != LCB_SUCCESS) {
+            callback(ResponseT{err});
+            return;
+        }
+        method(*shard, request, std::move(callback));
+    };
+    // HTTP requests are rare and too large to be worth keeping in place.
+    static_assert(std::is_same<RequestT, cb::HttpRequest>::value ||
+            cb::Scheduler::Task::fits<decltype(task)>(),
+        "scheduled tasks are expected to be kept in place");
+    shard->scheduler().post(
+        schedule, std::move(requestKeys), ops, bytes, std::move(task));
 }
 
-void httpCallback(lcb_http_request_t request, lcb_t instance,
-    const void *cookie, lcb_error_t err, const lcb_http_resp_t *resp)
+std::size_t bytes(const cb::GetRequest &request)
 {
-    auto response = const_cast<cb::HttpResponse *>(
-        static_cast<const cb::HttpResponse *>(cookie));
-    response->setError(err);
-    if (err == LCB_SUCCESS) {
-        response->setStatus(resp->v.v0.status);
-        response->setBody(resp->v.v0.bytes, resp->v.v0.nbytes);
-    }
+    return request.key().size();
 }
 
-void durabilityCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_durability_resp_t *resp)
+std::size_t bytes(const cb::StoreRequest &request)
 {
-    auto response = const_cast<cb::MultiResponse<cb::DurabilityResponse> *>(
-        static_cast<const cb::MultiResponse<cb::DurabilityResponse> *>(cookie));
-    if (err == LCB_SUCCESS) {
-        response->add(cb::DurabilityResponse{
-            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
-    }
-    else {
-        response->add(
-            cb::DurabilityResponse{err, resp->v.v0.key, resp->v.v0.nkey});
-    }
+    return request.key().size() + request.value().size();
 }
-} // namespace
 
-namespace cb {
+std::size_t bytes(const cb::RemoveRequest &request)
+{
+    return request.key().size();
+}
 
-Connection::Connection(const ConnectRequest &request)
+std::size_t bytes(const cb::ArithmeticRequest &request)
 {
-    struct lcb_create_st createOpts = {0};
-    createOpts.v.v0.host = request.host().c_str();
-    createOpts.v.v0.user = request.username().c_str();
-    createOpts.v.v0.passwd = request.password().c_str();
-    createOpts.v.v0.bucket = request.bucket().c_str();
-
-    lcb_error_t err = lcb_create(&m_instance, &createOpts);
-    if (err != LCB_SUCCESS) {
-        throw err;
-    }
+    return request.key().size();
+}
 
-    lcb_set_get_callback(m_instance, getCallback);
-    lcb_set_store_callback(m_instance, storeCallback);
-    lcb_set_arithmetic_callback(m_instance, arithmeticCallback);
-    lcb_set_remove_callback(m_instance, removeCallback);
-    lcb_set_http_complete_callback(m_instance, httpCallback);
-    lcb_set_durability_callback(m_instance, durabilityCallback);
-
-    std::string optName;
-    int optValue;
-    for (const auto &option : request.options()) {
-        std::tie(optName, optValue) = option;
-        if (optName == "operation_timeout") {
-            err = lcb_cntl(
-                m_instance, LCB_CNTL_SET, LCB_CNTL_OP_TIMEOUT, &optValue);
-        }
-        else if (optName == "config_total_timeout") {
-            err = lcb_cntl(m_instance, LCB_CNTL_SET,
-                LCB_CNTL_CONFIGURATION_TIMEOUT, &optValue);
-        }
-        else if (optName == "view_timeout") {
-            err = lcb_cntl(
-                m_instance, LCB_CNTL_SET, LCB_CNTL_VIEW_TIMEOUT, &optValue);
-        }
-        else if (optName == "durability_timeout") {
-            err = lcb_cntl(m_instance, LCB_CNTL_SET,
-                LCB_CNTL_DURABILITY_TIMEOUT, &optValue);
-        }
-        else if (optName == "durability_interval") {
-            err = lcb_cntl(m_instance, LCB_CNTL_SET,
-                LCB_CNTL_DURABILITY_INTERVAL, &optValue);
-        }
-        else if (optName == "http_timeout") {
-            err = lcb_cntl(
-                m_instance, LCB_CNTL_SET, LCB_CNTL_HTTP_TIMEOUT, &optValue);
-        }
-        if (err != LCB_SUCCESS) {
-            throw err;
-        }
-    }
+std::size_t bytes(const cb::DurabilityRequest &request)
+{
+    return request.key().size();
+}
 
-    err = lcb_connect(m_instance);
-    if (err != LCB_SUCCESS) {
-        throw err;
-    }
+std::size_t bytes(const cb::HttpRequest &request)
+{
+    return request.path().size() + request.body().size();
+}
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        throw err;
+template <class RequestT>
+std::size_t bytes(const cb::MultiRequest<RequestT> &request)
+{
+    std::size_t size = 0;
+    for (const auto &part : request.requests()) {
+        size += bytes(part);
     }
+    return size;
 }
 
-Connection::~Connection() { lcb_destroy(m_instance); }
+std::size_t ops(const cb::HttpRequest &) { return 1; }
 
-MultiResponse<GetResponse> Connection::get(
-    const MultiRequest<GetRequest> &request)
+template <class RequestT>
+std::size_t ops(const cb::MultiRequest<RequestT> &request)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_get_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.exptime = requests[i].expiry();
-        commands[i].v.v0.lock = requests[i].lock();
-    }
-    std::vector<const lcb_get_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    return request.requests().size();
+}
 
-    MultiResponse<GetResponse> response{LCB_SUCCESS};
-    lcb_error_t err;
+template <class ResponseT>
+cb::TrackedCallback<ResponseT> track(
+    cb::Admission admission, cb::Callback<ResponseT> callback)
+{
+    auto tracked = [
+        admission = std::move(admission), callback = std::move(callback)
+    ](const ResponseT &response) mutable
+    {
+        admission.release();
+        callback(response);
+    };
+    static_assert(
+        cb::TrackedCallback<ResponseT>::template fits<decltype(tracked)>(),
+        "tracked callbacks are expected to be kept in place");
+    return tracked;
+}
 
-    err = lcb_get(m_instance, &response, requests.size(), commandsPtr.data());
-    if (err != LCB_SUCCESS) {
-        return {err};
+template <class ResponseT> class Gather {
+public:
+    Gather(std::size_t parts, cb::TrackedCallback<ResponseT> callback)
+        : m_parts{parts}
+        , m_response{LCB_SUCCESS}
+        , m_callback{std::move(callback)}
+    {
+    }
+
+    void add(const ResponseT &response)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_response.merge(response);
+        if (--m_parts == 0) {
+            lock.unlock();
+            m_callback(m_response);
+        }
     }
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
-    }
+private:
+    std::mutex m_mutex;
+    std::size_t m_parts;
+    ResponseT m_response;
+    cb::TrackedCallback<ResponseT> m_callback;
+};
+} // namespace
+
+namespace cb {
+
+Admission::Admission(
+    ConnectionPtr connection, std::size_t ops, std::size_t bytes)
+    : m_connection{std::move(connection)}
+    , m_ops{ops}
+    , m_bytes{bytes}
+{
+}
 
-    return std::move(response);
+Admission::Admission(Admission &&other) noexcept
+    : m_connection{std::move(other.m_connection)}
+    , m_ops{other.m_ops}
+    , m_bytes{other.m_bytes}
+{
 }
 
-MultiResponse<StoreResponse> Connection::store(
-    const MultiRequest<StoreRequest> &request)
+Admission &Admission::operator=(Admission &&other) noexcept
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_store_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.operation = requests[i].operation();
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
-        commands[i].v.v0.flags = requests[i].flags();
-        commands[i].v.v0.bytes = requests[i].value().c_str();
-        commands[i].v.v0.nbytes = requests[i].value().size();
-        commands[i].v.v0.exptime = requests[i].expiry();
-    }
-    std::vector<const lcb_store_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    release();
+    m_connection = std::move(other.m_connection);
+    m_ops = other.m_ops;
+    m_bytes = other.m_bytes;
+    return *this;
+}
 
-    MultiResponse<StoreResponse> response{LCB_SUCCESS};
-    lcb_error_t err;
+Admission::~Admission() { release(); }
 
-    err = lcb_store(m_instance, &response, requests.size(), commandsPtr.data());
-    if (err != LCB_SUCCESS) {
-        return {err};
-    }
+Admission::operator bool() const { return static_cast<bool>(m_connection); }
+
+std::size_t Admission::ops() const { return m_ops; }
+
+std::size_t Admission::bytes() const { return m_bytes; }
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
+void Admission::release()
+{
+    if (m_connection) {
+        m_connection->release(m_ops, m_bytes);
+        m_connection.reset();
     }
+}
 
-    return std::move(response);
+Connection::Connection(ClientPtr client, std::vector<ShardPtr> shards,
+    std::size_t maxInflightOps, std::size_t maxInflightBytes, bool safeDecode)
+    : m_client{std::move(client)}
+    , m_shards{std::move(shards)}
+    , m_vbuckets{m_shards.front()->vbuckets()}
+    , m_maxInflightOps{maxInflightOps}
+    , m_maxInflightBytes{maxInflightBytes}
+    , m_safeDecode{safeDecode}
+{
 }
 
-MultiResponse<RemoveResponse> Connection::remove(
-    const MultiRequest<RemoveRequest> &request)
+void Connection::get(MultiRequest<GetRequest> request, Schedule schedule,
+    Admission admission, Callback<MultiResponse<GetResponse>> callback)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_remove_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
-    }
-    std::vector<const lcb_remove_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    dispatch(std::move(request), schedule, std::move(admission),
+        std::move(callback),
+        [](Shard &shard, const MultiRequest<GetRequest> &part,
+            TrackedCallback<MultiResponse<GetResponse>> partCallback) {
+            shard.get(part, std::move(partCallback));
+        });
+}
 
-    MultiResponse<RemoveResponse> response{LCB_SUCCESS};
-    lcb_error_t err;
+void Connection::store(MultiRequest<StoreRequest> request, Schedule schedule,
+    Admission admission, Callback<MultiResponse<StoreResponse>> callback)
+{
+    dispatch(std::move(request), schedule, std::move(admission),
+        std::move(callback),
+        [](Shard &shard, const MultiRequest<StoreRequest> &part,
+            TrackedCallback<MultiResponse<StoreResponse>> partCallback) {
+            shard.store(part, std::move(partCallback));
+        });
+}
 
-    err =
-        lcb_remove(m_instance, &response, requests.size(), commandsPtr.data());
-    if (err != LCB_SUCCESS) {
-        return {err};
-    }
+void Connection::remove(MultiRequest<RemoveRequest> request,
+    Schedule schedule, Admission admission,
+    Callback<MultiResponse<RemoveResponse>> callback)
+{
+    dispatch(std::move(request), schedule, std::move(admission),
+        std::move(callback),
+        [](Shard &shard, const MultiRequest<RemoveRequest> &part,
+            TrackedCallback<MultiResponse<RemoveResponse>> partCallback) {
+            shard.remove(part, std::move(partCallback));
+        });
+}
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
-    }
+void Connection::arithmetic(MultiRequest<ArithmeticRequest> request,
+    Schedule schedule, Admission admission,
+    Callback<MultiResponse<ArithmeticResponse>> callback)
+{
+    dispatch(std::move(request), schedule, std::move(admission),
+        std::move(callback),
+        [](Shard &shard, const MultiRequest<ArithmeticRequest> &part,
+            TrackedCallback<MultiResponse<ArithmeticResponse>>
+                partCallback) {
+            shard.arithmetic(part, std::move(partCallback));
+        });
+}
 
-    return std::move(response);
+void Connection::http(HttpRequest request, Schedule schedule,
+    Admission admission, Callback<HttpResponse> callback)
+{
+    auto size = admission.bytes();
+    post(m_shards[m_nextShard++ % m_shards.size()], schedule, 1, size,
+        std::move(request), track(std::move(admission), std::move(callback)),
+        [](Shard &shard, const HttpRequest &part,
+            TrackedCallback<HttpResponse> partCallback) {
+            shard.http(part, std::move(partCallback));
+        });
 }
 
-MultiResponse<ArithmeticResponse> Connection::arithmetic(
-    const MultiRequest<ArithmeticRequest> &request)
+void Connection::durability(MultiRequest<DurabilityRequest> request,
+    DurabilityRequestOptions options, Schedule schedule, Admission admission,
+    Callback<MultiResponse<DurabilityResponse>> callback)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_arithmetic_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.delta = requests[i].delta();
-        commands[i].v.v0.create = requests[i].create();
-        commands[i].v.v0.initial = requests[i].initial();
-        commands[i].v.v0.exptime = requests[i].expiry();
-    }
-    std::vector<const lcb_arithmetic_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    dispatch(std::move(request), schedule, std::move(admission),
+        std::move(callback),
+        [options](Shard &shard, const MultiRequest<DurabilityRequest> &part,
+            TrackedCallback<MultiResponse<DurabilityResponse>>
+                partCallback) {
+            shard.durability(part, options, std::move(partCallback));
+        });
+}
+
+Connection::Stats Connection::stats() const
+{
+    return {m_inflightOps, m_inflightBytes, m_maxInflightOps,
+        m_maxInflightBytes, m_rejected};
+}
 
-    MultiResponse<ArithmeticResponse> response{LCB_SUCCESS};
-    lcb_error_t err;
+bool Connection::safeDecode() const { return m_safeDecode; }
 
-    err = lcb_arithmetic(
-        m_instance, &response, requests.size(), commandsPtr.data());
-    if (err != LCB_SUCCESS) {
-        return {err};
+std::size_t Connection::shardIndex(const std::string &key) const
+{
+    std::size_t hash = (crc32(key) >> 16) & 0x7fff;
+    if (m_vbuckets > 0) {
+        hash %= m_vbuckets;
     }
+    return hash % m_shards.size();
+}
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
+template <class RequestT> Admission Connection::admit(const RequestT &request)
+{
+    auto requestOps = ops(request);
+    auto requestBytes = bytes(request);
+    if (!admit(requestOps, requestBytes)) {
+        return {};
     }
-
-    return std::move(response);
+    return {shared_from_this(), requestOps, requestBytes};
 }
 
-HttpResponse Connection::http(const HttpRequest &request)
+template Admission Connection::admit(const MultiRequest<GetRequest> &);
+template Admission Connection::admit(const MultiRequest<StoreRequest> &);
+template Admission Connection::admit(const MultiRequest<RemoveRequest> &);
+template Admission Connection::admit(
+    const MultiRequest<ArithmeticRequest> &);
+template Admission Connection::admit(const HttpRequest &);
+template Admission Connection::admit(
+    const MultiRequest<DurabilityRequest> &);
+
+template <class RequestT, class ResponseT, typename F>
+void Connection::dispatch(MultiRequest<RequestT> request,
+    const Schedule &schedule, Admission admission,
+    Callback<MultiResponse<ResponseT>> callback, F method)
 {
-    lcb_http_request_t req;
-    lcb_http_cmd_t command;
-    command.version = 0;
-    command.v.v0.method = request.method();
-    command.v.v0.path = request.path().c_str();
-    command.v.v0.npath = request.path().size();
-    command.v.v0.content_type = request.contentType().c_str();
-    command.v.v0.body = request.body().c_str();
-    command.v.v0.nbody = request.body().size();
-    command.v.v0.chunked = false;
-
-    HttpResponse response{LCB_SUCCESS};
-    lcb_error_t err;
-
-    err = lcb_make_http_request(
-        m_instance, &response, request.type(), &command, &req);
-    if (err != LCB_SUCCESS) {
-        return {err};
+    auto requestOps = admission.ops();
+    auto requestBytes = admission.bytes();
+    auto tracked = track(std::move(admission), std::move(callback));
+
+    // Replies cannot be sent from the thread of the caller, so even an empty
+    // request is answered from the io_service of a shard.
+    if (requestOps == 0) {
+        asio::post(m_shards.front()->ioService(),
+            [ tracked = std::move(tracked) ]() mutable {
+                tracked(MultiResponse<ResponseT>{LCB_SUCCESS});
+            });
+        return;
     }
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
+    if (m_shards.size() == 1) {
+        post(m_shards.front(), schedule, requestOps, requestBytes,
+            std::move(request), std::move(tracked), method);
+        return;
     }
 
-    return std::move(response);
-}
+    auto &requests = request.requests();
+    std::vector<std::size_t> indices(requests.size());
+    std::vector<std::size_t> counts(m_shards.size());
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        indices[i] = shardIndex(requests[i].key());
+        ++counts[indices[i]];
+    }
 
-MultiResponse<DurabilityResponse> Connection::durability(
-    const MultiRequest<DurabilityRequest> &request,
-    const DurabilityRequestOptions &requestOptions)
-{
-    const auto &requests = request.requests();
-    std::vector<lcb_durability_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
+    std::size_t size = 0;
+    std::vector<MultiRequest<RequestT>> parts{m_shards.size()};
+    for (std::size_t i = 0; i < m_shards.size(); ++i) {
+        parts[i].reserve(counts[i]);
+        size += counts[i] > 0 ? 1 : 0;
     }
-    std::vector<const lcb_durability_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        parts[indices[i]].add(std::move(requests[i]));
     }
 
-    lcb_durability_opts_t options = {};
-    options.v.v0.persist_to = requestOptions.persistTo();
-    options.v.v0.replicate_to = requestOptions.replicateTo();
-    options.v.v0.cap_max = 1;
+    auto gather = std::make_shared<Gather<MultiResponse<ResponseT>>>(
+        size, std::move(tracked));
 
-    MultiResponse<DurabilityResponse> response{LCB_SUCCESS};
-    lcb_error_t err;
-
-    err = lcb_durability_poll(
-        m_instance, &response, &options, requests.size(), commandsPtr.data());
-    if (err != LCB_SUCCESS) {
-        return {err};
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        if (parts[i].requests().empty()) {
+            continue;
+        }
+        auto partOps = parts[i].requests().size();
+        auto partBytes = bytes(parts[i]);
+        post(m_shards[i], schedule, partOps, partBytes, std::move(parts[i]),
+            TrackedCallback<MultiResponse<ResponseT>>{
+                [gather](const MultiResponse<ResponseT> &response) {
+                    gather->add(response);
+                }},
+            method);
     }
+}
 
-    err = lcb_wait(m_instance);
-    if (err != LCB_SUCCESS) {
-        return {err};
+bool Connection::admit(std::size_t ops, std::size_t bytes)
+{
+    auto inflightOps = m_inflightOps.fetch_add(ops);
+    auto inflightBytes = m_inflightBytes.fetch_add(bytes);
+
+    // A request over the limits on its own is still let through when the
+    // connection is idle, so that it does not fail forever.
+    if (inflightOps > 0 &&
+        ((m_maxInflightOps > 0 && inflightOps + ops > m_maxInflightOps) ||
+            (m_maxInflightBytes > 0 &&
+                inflightBytes + bytes > m_maxInflightBytes))) {
+        release(ops, bytes);
+        ++m_rejected;
+        return false;
     }
 
-    return std::move(response);
+    return true;
+}
+
+void Connection::release(std::size_t ops, std::size_t bytes)
+{
+    m_inflightOps -= ops;
+    m_inflightBytes -= bytes;
 }
 
 } // namespace cb
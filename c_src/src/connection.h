@@ -10,38 +10,135 @@
 
 #include "requests/requests.h"
 #include "responses/responses.h"
+#include "scheduler.h"
+#include "types.h"
 
-#include <libcouchbase/couchbase.h>
-
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace cb {
 
-class Connection {
+/**
+ * In-flight budget taken by a request admitted to a connection. The budget is
+ * given back when the admission is released or destroyed, so a request that
+ * fails before it is dispatched does not keep it.
+ */
+class Admission {
 public:
-    Connection(const ConnectRequest &bucket);
+    Admission() = default;
+
+    Admission(ConnectionPtr connection, std::size_t ops, std::size_t bytes);
 
-    ~Connection();
+    Admission(Admission &&other) noexcept;
 
-    MultiResponse<GetResponse> get(const MultiRequest<GetRequest> &request);
+    Admission &operator=(Admission &&other) noexcept;
 
-    MultiResponse<StoreResponse> store(
-        const MultiRequest<StoreRequest> &request);
+    ~Admission();
 
-    MultiResponse<RemoveResponse> remove(
-        const MultiRequest<RemoveRequest> &request);
+    /**
+     * Tells whether the request has been admitted.
+     */
+    explicit operator bool() const;
 
-    MultiResponse<ArithmeticResponse> arithmetic(
-        const MultiRequest<ArithmeticRequest> &request);
+    std::size_t ops() const;
 
-    HttpResponse http(const HttpRequest &request);
+    std::size_t bytes() const;
+
+    void release();
+
+private:
+    ConnectionPtr m_connection;
+    std::size_t m_ops = 0;
+    std::size_t m_bytes = 0;
+};
 
-    MultiResponse<DurabilityResponse> durability(
-        const MultiRequest<DurabilityRequest> &request,
-        const DurabilityRequestOptions &options);
+/**
+ * Connection to a bucket backed by one or more shards. Keys are routed to
+ * shards by their vBucket, so that all operations on a key are executed in
+ * order by the same libcouchbase instance. The connection keeps the client
+ * alive, as its workers drive the shards.
+ *
+ * The number of keys and bytes of keys and values in flight may be limited.
+ * Requests over the limits are rejected, unless nothing is in flight. A
+ * request is admitted before it is made, so that a rejected one costs
+ * nothing more than the check.
+ */
+class Connection : public std::enable_shared_from_this<Connection> {
+public:
+    struct Stats {
+        std::size_t inflightOps;
+        std::size_t inflightBytes;
+        std::size_t maxInflightOps;
+        std::size_t maxInflightBytes;
+        std::size_t rejected;
+    };
+
+    Connection(ClientPtr client, std::vector<ShardPtr> shards,
+        std::size_t maxInflightOps = 0, std::size_t maxInflightBytes = 0,
+        bool safeDecode = false);
+
+    /**
+     * Takes the in-flight budget of the request. Returns an empty admission
+     * if the connection is overloaded.
+     */
+    template <class RequestT> Admission admit(const RequestT &request);
+
+    void get(MultiRequest<GetRequest> request, Schedule schedule,
+        Admission admission, Callback<MultiResponse<GetResponse>> callback);
+
+    void store(MultiRequest<StoreRequest> request, Schedule schedule,
+        Admission admission, Callback<MultiResponse<StoreResponse>> callback);
+
+    void remove(MultiRequest<RemoveRequest> request, Schedule schedule,
+        Admission admission,
+        Callback<MultiResponse<RemoveResponse>> callback);
+
+    void arithmetic(MultiRequest<ArithmeticRequest> request,
+        Schedule schedule, Admission admission,
+        Callback<MultiResponse<ArithmeticResponse>> callback);
+
+    void http(HttpRequest request, Schedule schedule, Admission admission,
+        Callback<HttpResponse> callback);
+
+    void durability(MultiRequest<DurabilityRequest> request,
+        DurabilityRequestOptions options, Schedule schedule,
+        Admission admission,
+        Callback<MultiResponse<DurabilityResponse>> callback);
+
+    Stats stats() const;
+
+    /**
+     * Tells whether values stored as Erlang terms are decoded in the safe
+     * mode of binary_to_term, which does not create atoms or functions.
+     */
+    bool safeDecode() const;
 
 private:
-    lcb_t m_instance;
+    friend class Admission;
+
+    std::size_t shardIndex(const std::string &key) const;
+
+    template <class RequestT, class ResponseT, typename F>
+    void dispatch(MultiRequest<RequestT> request, const Schedule &schedule,
+        Admission admission, Callback<MultiResponse<ResponseT>> callback,
+        F method);
+
+    bool admit(std::size_t ops, std::size_t bytes);
+
+    void release(std::size_t ops, std::size_t bytes);
+
+    ClientPtr m_client;
+    std::vector<ShardPtr> m_shards;
+    std::size_t m_vbuckets;
+    std::atomic<std::size_t> m_nextShard{0};
+    std::size_t m_maxInflightOps;
+    std::size_t m_maxInflightBytes;
+    bool m_safeDecode;
+    std::atomic<std::size_t> m_inflightOps{0};
+    std::atomic<std::size_t> m_inflightBytes{0};
+    std::atomic<std::size_t> m_rejected{0};
 };
 
 } // namespace cb
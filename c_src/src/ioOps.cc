@@ -0,0 +1,226 @@
+/**
+ * @file ioOps.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "ioOps.h"
+
+#include <asio/posix/stream_descriptor.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace {
+asio::io_service &ioService(lcb_io_opt_t iops)
+{
+    return *static_cast<asio::io_service *>(iops->v.v3.cookie);
+}
+
+class Event : public std::enable_shared_from_this<Event> {
+public:
+    Event(asio::io_service &ioService)
+        : m_descriptor{ioService}
+    {
+    }
+
+    void watch(lcb_socket_t socket, short flags, void *arg,
+        lcb_ioE_callback callback)
+    {
+        cancel();
+        if (socket != m_socket) {
+            release();
+            m_descriptor.assign(socket);
+            m_socket = socket;
+        }
+
+        m_arg = arg;
+        m_callback = callback;
+
+        if (flags & LCB_READ_EVENT) {
+            wait(asio::posix::stream_descriptor::wait_read, LCB_READ_EVENT);
+        }
+        if (flags & LCB_WRITE_EVENT) {
+            wait(asio::posix::stream_descriptor::wait_write, LCB_WRITE_EVENT);
+        }
+    }
+
+    void cancel()
+    {
+        ++m_generation;
+        if (m_socket != -1) {
+            asio::error_code ec;
+            m_descriptor.cancel(ec);
+        }
+    }
+
+    void release()
+    {
+        cancel();
+        if (m_socket != -1) {
+            // The socket is owned and closed by libcouchbase.
+            m_descriptor.release();
+            m_socket = -1;
+        }
+    }
+
+private:
+    void wait(asio::posix::stream_descriptor::wait_type type, short flag)
+    {
+        m_descriptor.async_wait(type, [
+            self = shared_from_this(), generation = m_generation, type, flag
+        ](const asio::error_code &ec) {
+            if (ec || generation != self->m_generation) {
+                return;
+            }
+            self->m_callback(self->m_socket, flag, self->m_arg);
+            // Like with the libev and libevent plugins, an event stays armed
+            // until it is cancelled or watched again.
+            if (generation == self->m_generation) {
+                self->wait(type, flag);
+            }
+        });
+    }
+
+    asio::posix::stream_descriptor m_descriptor;
+    lcb_socket_t m_socket = -1;
+    std::uint64_t m_generation = 0;
+    void *m_arg = nullptr;
+    lcb_ioE_callback m_callback = nullptr;
+};
+
+class Timer : public std::enable_shared_from_this<Timer> {
+public:
+    Timer(asio::io_service &ioService)
+        : m_timer{ioService}
+    {
+    }
+
+    void schedule(lcb_U32 usecs, void *arg, lcb_ioE_callback callback)
+    {
+        cancel();
+        m_timer.expires_after(std::chrono::microseconds{usecs});
+        m_timer.async_wait([
+            self = shared_from_this(), generation = m_generation, arg, callback
+        ](const asio::error_code &ec) {
+            if (!ec && generation == self->m_generation) {
+                callback(-1, 0, arg);
+            }
+        });
+    }
+
+    void cancel()
+    {
+        ++m_generation;
+        asio::error_code ec;
+        m_timer.cancel(ec);
+    }
+
+private:
+    asio::steady_timer m_timer;
+    std::uint64_t m_generation = 0;
+};
+
+template <typename T> void *create(lcb_io_opt_t iops)
+{
+    return new std::shared_ptr<T>{std::make_shared<T>(ioService(iops))};
+}
+
+template <typename T> T &get(void *handle)
+{
+    return **static_cast<std::shared_ptr<T> *>(handle);
+}
+
+template <typename T> void destroy(void *handle)
+{
+    delete static_cast<std::shared_ptr<T> *>(handle);
+}
+
+void *createEvent(lcb_io_opt_t iops) { return create<Event>(iops); }
+
+void destroyEvent(lcb_io_opt_t, void *event)
+{
+    get<Event>(event).release();
+    destroy<Event>(event);
+}
+
+void cancelEvent(lcb_io_opt_t, lcb_socket_t, void *event)
+{
+    get<Event>(event).cancel();
+}
+
+int watchEvent(lcb_io_opt_t, lcb_socket_t socket, void *event, short flags,
+    void *arg, lcb_ioE_callback callback)
+{
+    try {
+        get<Event>(event).watch(socket, flags, arg, callback);
+        return 0;
+    }
+    catch (const asio::system_error &) {
+        return -1;
+    }
+}
+
+void *createTimer(lcb_io_opt_t iops) { return create<Timer>(iops); }
+
+void destroyTimer(lcb_io_opt_t, void *timer)
+{
+    get<Timer>(timer).cancel();
+    destroy<Timer>(timer);
+}
+
+void cancelTimer(lcb_io_opt_t, void *timer) { get<Timer>(timer).cancel(); }
+
+int scheduleTimer(lcb_io_opt_t, void *timer, lcb_U32 usecs, void *arg,
+    lcb_ioE_callback callback)
+{
+    get<Timer>(timer).schedule(usecs, arg, callback);
+    return 0;
+}
+
+void startLoop(lcb_io_opt_t) {}
+
+void stopLoop(lcb_io_opt_t) {}
+
+void getProcs(int version, lcb_loopprocs *loop, lcb_timerprocs *timer,
+    lcb_bsdprocs *bsd, lcb_evprocs *ev, lcb_completion_procs *,
+    lcb_iomodel_t *model)
+{
+    *model = LCB_IOMODEL_EVENT;
+
+    loop->start = startLoop;
+    loop->stop = stopLoop;
+
+    timer->create = createTimer;
+    timer->destroy = destroyTimer;
+    timer->cancel = cancelTimer;
+    timer->schedule = scheduleTimer;
+
+    ev->create = createEvent;
+    ev->destroy = destroyEvent;
+    ev->cancel = cancelEvent;
+    ev->watch = watchEvent;
+
+    lcb_iops_wire_bsd_impl2(bsd, version);
+}
+
+void destroyIoOps(lcb_io_opt_t iops) { delete iops; }
+} // namespace
+
+namespace cb {
+
+lcb_io_opt_t createIoOps(asio::io_service &ioService)
+{
+    auto iops = new lcb_io_opt_st{};
+    iops->version = 3;
+    iops->destructor = destroyIoOps;
+    iops->v.v3.cookie = &ioService;
+    iops->v.v3.need_cleanup = 1;
+    iops->v.v3.get_procs = getProcs;
+    return iops;
+}
+
+} // namespace cb
@@ -0,0 +1,27 @@
+/**
+ * @file ioOps.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_IO_OPS_H
+#define COUCHBASE_IO_OPS_H
+
+#include <asio/io_service.hpp>
+#include <libcouchbase/couchbase.h>
+
+namespace cb {
+
+/**
+ * Creates libcouchbase IO operations that watch sockets and run timers on the
+ * given io_service. The event loop is never started by libcouchbase itself,
+ * it is run by the worker thread that owns the io_service, so many instances
+ * can share it without blocking each other. The returned structure is owned
+ * by the libcouchbase instance it is passed to.
+ */
+lcb_io_opt_t createIoOps(asio::io_service &ioService);
+
+} // namespace cb
+
+#endif // COUCHBASE_IO_OPS_H
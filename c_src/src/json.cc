@@ -0,0 +1,1055 @@
+/**
+ * @file json.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "json.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr int kMaxDepth = 512;
+
+ERL_NIF_TERM atomTrue;
+ERL_NIF_TERM atomFalse;
+ERL_NIF_TERM atomNull;
+ERL_NIF_TERM atomJson;
+ERL_NIF_TERM atomUndefined;
+
+bool isSpace(unsigned char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/**
+ * Returns the first character that has to be escaped in a JSON string, that
+ * is a quote, a backslash or a control character, or the end of the data.
+ */
+const unsigned char *findSpecial(
+    const unsigned char *pos, const unsigned char *end)
+{
+#ifdef __SSE2__
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+    const auto control = _mm_set1_epi8(0x1f);
+    while (end - pos >= 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        // Unsigned bytes not greater than 0x1f are left unchanged by max.
+        auto special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        auto mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < end && *pos != '"' && *pos != '\\' && *pos >= 0x20) {
+        ++pos;
+    }
+    return pos;
+}
+
+void appendUtf8(std::string &out, std::uint32_t codepoint)
+{
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    }
+    else if (codepoint < 0x800) {
+        out += static_cast<char>(0xc0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+    else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xe0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+    else {
+        out += static_cast<char>(0xf0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+}
+
+class Decoder {
+public:
+    Decoder(ErlNifEnv *env, const unsigned char *data, std::size_t size)
+        : m_env{env}
+        , m_pos{data}
+        , m_end{data + size}
+        , m_stack{stack()}
+        , m_base{m_stack.size()}
+    {
+    }
+
+    ~Decoder() { m_stack.resize(m_base); }
+
+    bool decode(ERL_NIF_TERM &term)
+    {
+        skipSpace();
+        if (!decodeValue(term)) {
+            return false;
+        }
+        skipSpace();
+        return m_pos == m_end;
+    }
+
+    /**
+     * Decodes the value at the current position, leaving the position after
+     * it.
+     */
+    bool decodeValue(ERL_NIF_TERM &term)
+    {
+        if (!value(0)) {
+            return false;
+        }
+        term = m_stack.back();
+        m_stack.pop_back();
+        return true;
+    }
+
+    const unsigned char *position() const { return m_pos; }
+
+private:
+    // Terms of arrays and objects being decoded are kept on one stack shared
+    // by all decoders of a thread, so that no memory is allocated per value.
+    static std::vector<ERL_NIF_TERM> &stack()
+    {
+        thread_local std::vector<ERL_NIF_TERM> terms;
+        return terms;
+    }
+
+    void skipSpace()
+    {
+        while (m_pos < m_end && isSpace(*m_pos)) {
+            ++m_pos;
+        }
+    }
+
+    bool value(int depth)
+    {
+        if (m_pos == m_end || depth > kMaxDepth) {
+            return false;
+        }
+
+        switch (*m_pos) {
+            case '{':
+                return object(depth);
+            case '[':
+                return array(depth);
+            case '"':
+                return string();
+            case 't':
+                return literal("true", atomTrue);
+            case 'f':
+                return literal("false", atomFalse);
+            case 'n':
+                return literal("null", atomNull);
+            default:
+                return number();
+        }
+    }
+
+    bool object(int depth)
+    {
+        ++m_pos;
+        skipSpace();
+        auto base = m_stack.size();
+        if (m_pos < m_end && *m_pos == '}') {
+            ++m_pos;
+        }
+        else {
+            for (;;) {
+                if (m_pos == m_end || *m_pos != '"' || !string()) {
+                    return false;
+                }
+                skipSpace();
+                if (m_pos == m_end || *m_pos != ':') {
+                    return false;
+                }
+                ++m_pos;
+                skipSpace();
+                if (!value(depth + 1)) {
+                    return false;
+                }
+                auto pair = enif_make_tuple2(m_env,
+                    m_stack[m_stack.size() - 2], m_stack[m_stack.size() - 1]);
+                m_stack.pop_back();
+                m_stack.back() = pair;
+                bool closed;
+                if (!next('}', closed)) {
+                    return false;
+                }
+                if (closed) {
+                    break;
+                }
+            }
+        }
+
+        auto members = enif_make_list_from_array(
+            m_env, m_stack.data() + base, m_stack.size() - base);
+        m_stack.resize(base);
+        m_stack.push_back(enif_make_tuple1(m_env, members));
+        return true;
+    }
+
+    bool array(int depth)
+    {
+        ++m_pos;
+        skipSpace();
+        auto base = m_stack.size();
+        if (m_pos < m_end && *m_pos == ']') {
+            ++m_pos;
+        }
+        else {
+            for (;;) {
+                bool closed;
+                if (!value(depth + 1) || !next(']', closed)) {
+                    return false;
+                }
+                if (closed) {
+                    break;
+                }
+            }
+        }
+
+        auto elements = enif_make_list_from_array(
+            m_env, m_stack.data() + base, m_stack.size() - base);
+        m_stack.resize(base);
+        m_stack.push_back(elements);
+        return true;
+    }
+
+    /**
+     * Consumes a separator or the closing character after a value.
+     */
+    bool next(unsigned char close, bool &closed)
+    {
+        skipSpace();
+        if (m_pos == m_end || (*m_pos != ',' && *m_pos != close)) {
+            return false;
+        }
+        closed = *m_pos++ == close;
+        if (!closed) {
+            skipSpace();
+        }
+        return true;
+    }
+
+    bool string()
+    {
+        auto start = ++m_pos;
+        m_pos = findSpecial(m_pos, m_end);
+        if (m_pos < m_end && *m_pos == '"') {
+            // Strings without escapes are copied as they are.
+            push(start, m_pos - start);
+            ++m_pos;
+            return true;
+        }
+
+        m_scratch.assign(reinterpret_cast<const char *>(start), m_pos - start);
+        while (m_pos < m_end && *m_pos == '\\') {
+            if (!escape()) {
+                return false;
+            }
+            auto run = m_pos;
+            m_pos = findSpecial(m_pos, m_end);
+            m_scratch.append(reinterpret_cast<const char *>(run), m_pos - run);
+        }
+        if (m_pos == m_end || *m_pos != '"') {
+            return false;
+        }
+
+        push(reinterpret_cast<const unsigned char *>(m_scratch.data()),
+            m_scratch.size());
+        ++m_pos;
+        return true;
+    }
+
+    bool escape()
+    {
+        if (m_end - m_pos < 2) {
+            return false;
+        }
+
+        auto c = m_pos[1];
+        m_pos += 2;
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                m_scratch += static_cast<char>(c);
+                return true;
+            case 'b':
+                m_scratch += '\b';
+                return true;
+            case 'f':
+                m_scratch += '\f';
+                return true;
+            case 'n':
+                m_scratch += '\n';
+                return true;
+            case 'r':
+                m_scratch += '\r';
+                return true;
+            case 't':
+                m_scratch += '\t';
+                return true;
+            case 'u':
+                break;
+            default:
+                return false;
+        }
+
+        std::uint32_t codepoint;
+        if (!hex(codepoint)) {
+            return false;
+        }
+        if (codepoint >= 0xd800 && codepoint < 0xdc00) {
+            std::uint32_t low;
+            if (m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u') {
+                return false;
+            }
+            m_pos += 2;
+            if (!hex(low) || low < 0xdc00 || low >= 0xe000) {
+                return false;
+            }
+            codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+        }
+        else if (codepoint >= 0xdc00 && codepoint < 0xe000) {
+            return false;
+        }
+        appendUtf8(m_scratch, codepoint);
+        return true;
+    }
+
+    bool hex(std::uint32_t &value)
+    {
+        if (m_end - m_pos < 4) {
+            return false;
+        }
+
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            auto c = *m_pos++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f') {
+                value |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F') {
+                value |= c - 'A' + 10;
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool literal(const char *text, ERL_NIF_TERM atom)
+    {
+        auto size = std::strlen(text);
+        if (static_cast<std::size_t>(m_end - m_pos) < size ||
+            std::memcmp(m_pos, text, size) != 0) {
+            return false;
+        }
+        m_pos += size;
+        m_stack.push_back(atom);
+        return true;
+    }
+
+    bool number()
+    {
+        auto start = m_pos;
+        bool negative = false;
+        bool integer = true;
+        bool overflow = false;
+        std::uint64_t magnitude = 0;
+
+        if (*m_pos == '-') {
+            negative = true;
+            ++m_pos;
+        }
+        if (m_pos == m_end || !isDigit(*m_pos)) {
+            return false;
+        }
+        if (*m_pos == '0') {
+            ++m_pos;
+        }
+        else {
+            while (m_pos < m_end && isDigit(*m_pos)) {
+                std::uint64_t digit = *m_pos++ - '0';
+                if (magnitude > (std::numeric_limits<std::uint64_t>::max() -
+                                    digit) / 10) {
+                    overflow = true;
+                }
+                magnitude = magnitude * 10 + digit;
+            }
+        }
+        if (m_pos < m_end && *m_pos == '.') {
+            integer = false;
+            ++m_pos;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (m_pos < m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+            integer = false;
+            ++m_pos;
+            if (m_pos < m_end && (*m_pos == '+' || *m_pos == '-')) {
+                ++m_pos;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+
+        constexpr std::uint64_t maxInt64 =
+            std::numeric_limits<std::int64_t>::max();
+        if (integer && !overflow) {
+            if (!negative) {
+                m_stack.push_back(enif_make_uint64(m_env, magnitude));
+                return true;
+            }
+            if (magnitude <= maxInt64 + 1) {
+                m_stack.push_back(enif_make_int64(m_env,
+                    magnitude == maxInt64 + 1
+                        ? std::numeric_limits<std::int64_t>::min()
+                        : -static_cast<std::int64_t>(magnitude)));
+                return true;
+            }
+        }
+
+        // Integers beyond 64 bits cannot be made by NIFs and become floats.
+        m_scratch.assign(reinterpret_cast<const char *>(start), m_pos - start);
+        double value = std::strtod(m_scratch.c_str(), nullptr);
+        if (value > std::numeric_limits<double>::max() ||
+            value < std::numeric_limits<double>::lowest()) {
+            return false;
+        }
+        m_stack.push_back(enif_make_double(m_env, value));
+        return true;
+    }
+
+    bool digits()
+    {
+        auto start = m_pos;
+        while (m_pos < m_end && isDigit(*m_pos)) {
+            ++m_pos;
+        }
+        return m_pos != start;
+    }
+
+    static bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+    void push(const unsigned char *data, std::size_t size)
+    {
+        ERL_NIF_TERM term;
+        auto bytes = enif_make_new_binary(m_env, size, &term);
+        std::memcpy(bytes, data, size);
+        m_stack.push_back(term);
+    }
+
+    ErlNifEnv *m_env;
+    const unsigned char *m_pos;
+    const unsigned char *m_end;
+    std::vector<ERL_NIF_TERM> &m_stack;
+    std::size_t m_base;
+    std::string m_scratch;
+};
+
+class Encoder {
+public:
+    Encoder(ErlNifEnv *env, std::string &out)
+        : m_env{env}
+        , m_out{out}
+    {
+    }
+
+    bool encode(ERL_NIF_TERM term, int depth)
+    {
+        if (depth > kMaxDepth) {
+            return false;
+        }
+
+        ErlNifBinary bin;
+        ErlNifSInt64 integer;
+        ErlNifUInt64 unsignedInteger;
+        double floating;
+        const ERL_NIF_TERM *elements;
+        int arity;
+
+        if (enif_inspect_binary(m_env, term, &bin)) {
+            string(bin.data, bin.size);
+        }
+        else if (enif_is_atom(m_env, term)) {
+            return atom(term);
+        }
+        else if (enif_get_int64(m_env, term, &integer)) {
+            char digits[24];
+            m_out.append(digits, std::snprintf(digits, sizeof(digits), "%lld",
+                                     static_cast<long long>(integer)));
+        }
+        else if (enif_get_uint64(m_env, term, &unsignedInteger)) {
+            char digits[24];
+            m_out.append(digits,
+                std::snprintf(digits, sizeof(digits), "%llu",
+                    static_cast<unsigned long long>(unsignedInteger)));
+        }
+        else if (enif_get_double(m_env, term, &floating)) {
+            number(floating);
+        }
+        else if (enif_is_list(m_env, term)) {
+            return array(term, depth);
+        }
+        else if (enif_get_tuple(m_env, term, &arity, &elements) &&
+            arity == 1 && enif_is_list(m_env, elements[0])) {
+            return object(elements[0], depth);
+        }
+        else if (enif_is_map(m_env, term)) {
+            return map(term, depth);
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool atom(ERL_NIF_TERM term)
+    {
+        if (enif_is_identical(term, atomTrue)) {
+            m_out += "true";
+        }
+        else if (enif_is_identical(term, atomFalse)) {
+            m_out += "false";
+        }
+        else if (enif_is_identical(term, atomNull)) {
+            m_out += "null";
+        }
+        else {
+            return atomName(term);
+        }
+        return true;
+    }
+
+    /**
+     * Encodes the name of an atom as a string.
+     */
+    bool atomName(ERL_NIF_TERM term)
+    {
+        unsigned int length;
+        if (!enif_get_atom_length(m_env, term, &length, ERL_NIF_LATIN1)) {
+            return false;
+        }
+
+        std::vector<char> name(length + 1);
+        enif_get_atom(m_env, term, name.data(), name.size(), ERL_NIF_LATIN1);
+        std::string utf8;
+        for (unsigned int i = 0; i < length; ++i) {
+            appendUtf8(utf8, static_cast<unsigned char>(name[i]));
+        }
+        string(reinterpret_cast<const unsigned char *>(utf8.data()),
+            utf8.size());
+        return true;
+    }
+
+    bool array(ERL_NIF_TERM list, int depth)
+    {
+        ERL_NIF_TERM head;
+        bool first = true;
+        m_out += '[';
+        while (enif_get_list_cell(m_env, list, &head, &list)) {
+            if (!first) {
+                m_out += ',';
+            }
+            first = false;
+            if (!encode(head, depth + 1)) {
+                return false;
+            }
+        }
+        m_out += ']';
+        return enif_is_empty_list(m_env, list);
+    }
+
+    bool object(ERL_NIF_TERM list, int depth)
+    {
+        ERL_NIF_TERM head;
+        const ERL_NIF_TERM *pair;
+        int arity;
+        bool first = true;
+        m_out += '{';
+        while (enif_get_list_cell(m_env, list, &head, &list)) {
+            if (!enif_get_tuple(m_env, head, &arity, &pair) || arity != 2) {
+                return false;
+            }
+            if (!first) {
+                m_out += ',';
+            }
+            first = false;
+            if (!member(pair[0], pair[1], depth)) {
+                return false;
+            }
+        }
+        m_out += '}';
+        return enif_is_empty_list(m_env, list);
+    }
+
+    bool map(ERL_NIF_TERM term, int depth)
+    {
+        ErlNifMapIterator iterator;
+        if (!enif_map_iterator_create(
+                m_env, term, &iterator, ERL_NIF_MAP_ITERATOR_FIRST)) {
+            return false;
+        }
+
+        ERL_NIF_TERM key, value;
+        bool first = true;
+        bool valid = true;
+        m_out += '{';
+        while (valid &&
+            enif_map_iterator_get_pair(m_env, &iterator, &key, &value)) {
+            if (!first) {
+                m_out += ',';
+            }
+            first = false;
+            valid = member(key, value, depth);
+            enif_map_iterator_next(m_env, &iterator);
+        }
+        m_out += '}';
+        enif_map_iterator_destroy(m_env, &iterator);
+        return valid;
+    }
+
+    bool member(ERL_NIF_TERM key, ERL_NIF_TERM value, int depth)
+    {
+        ErlNifBinary bin;
+        if (enif_inspect_binary(m_env, key, &bin)) {
+            string(bin.data, bin.size);
+        }
+        else if (!enif_is_atom(m_env, key) || !atomName(key)) {
+            return false;
+        }
+        m_out += ':';
+        return encode(value, depth + 1);
+    }
+
+    void string(const unsigned char *pos, std::size_t size)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+        auto end = pos + size;
+        m_out += '"';
+        for (;;) {
+            auto special = findSpecial(pos, end);
+            m_out.append(reinterpret_cast<const char *>(pos), special - pos);
+            if (special == end) {
+                break;
+            }
+            switch (*special) {
+                case '"':
+                    m_out += "\\\"";
+                    break;
+                case '\\':
+                    m_out += "\\\\";
+                    break;
+                case '\b':
+                    m_out += "\\b";
+                    break;
+                case '\f':
+                    m_out += "\\f";
+                    break;
+                case '\n':
+                    m_out += "\\n";
+                    break;
+                case '\r':
+                    m_out += "\\r";
+                    break;
+                case '\t':
+                    m_out += "\\t";
+                    break;
+                default:
+                    m_out += "\\u00";
+                    m_out += hexDigits[*special >> 4];
+                    m_out += hexDigits[*special & 0xf];
+            }
+            pos = special + 1;
+        }
+        m_out += '"';
+    }
+
+    void number(double value)
+    {
+        // The shortest representation that reads back as the same value.
+        char digits[32];
+        int size = 0;
+        for (int precision = 15; precision <= 17; ++precision) {
+            size = std::snprintf(
+                digits, sizeof(digits), "%.*g", precision, value);
+            if (std::strtod(digits, nullptr) == value) {
+                break;
+            }
+        }
+        m_out.append(digits, size);
+        if (!std::strpbrk(digits, ".e")) {
+            m_out += ".0";
+        }
+    }
+
+    ErlNifEnv *m_env;
+    std::string &m_out;
+};
+
+class Projector {
+public:
+    Projector(ErlNifEnv *env, const unsigned char *data, std::size_t size,
+        const std::vector<cb::json::Path> &paths,
+        std::vector<ERL_NIF_TERM> &values)
+        : m_env{env}
+        , m_pos{data}
+        , m_end{data + size}
+        , m_paths{paths}
+        , m_values{values}
+        , m_found(paths.size(), false)
+        , m_remaining{paths.size()}
+    {
+    }
+
+    bool project()
+    {
+        m_values.assign(m_paths.size(), atomUndefined);
+        if (m_paths.empty()) {
+            return true;
+        }
+
+        std::vector<std::size_t> active(m_paths.size());
+        for (std::size_t i = 0; i < active.size(); ++i) {
+            active[i] = i;
+        }
+        skipSpace();
+        return value(active, 0, 0);
+    }
+
+private:
+    void skipSpace()
+    {
+        while (m_pos < m_end && isSpace(*m_pos)) {
+            ++m_pos;
+        }
+    }
+
+    /**
+     * Visits a value whose location matches the first elements of the
+     * active paths. The value is decoded for paths ending at it and scanned
+     * for paths leading into it.
+     */
+    bool value(const std::vector<std::size_t> &active, std::size_t length,
+        int depth)
+    {
+        if (m_pos == m_end || depth > kMaxDepth) {
+            return false;
+        }
+
+        std::vector<std::size_t> deeper;
+        const unsigned char *end = nullptr;
+        ERL_NIF_TERM term = 0;
+        for (auto i : active) {
+            if (m_found[i]) {
+                continue;
+            }
+            if (m_paths[i].size() > length) {
+                deeper.push_back(i);
+                continue;
+            }
+            if (!end) {
+                Decoder decoder{m_env, m_pos,
+                    static_cast<std::size_t>(m_end - m_pos)};
+                if (!decoder.decodeValue(term)) {
+                    return false;
+                }
+                end = decoder.position();
+            }
+            found(i, term);
+        }
+
+        if (!deeper.empty() && *m_pos == '{') {
+            return object(deeper, length, depth);
+        }
+        if (!deeper.empty() && *m_pos == '[') {
+            return array(deeper, length, depth);
+        }
+        if (end) {
+            m_pos = end;
+            return true;
+        }
+        return skip(depth);
+    }
+
+    bool object(const std::vector<std::size_t> &active, std::size_t length,
+        int depth)
+    {
+        ++m_pos;
+        skipSpace();
+        if (m_pos < m_end && *m_pos == '}') {
+            ++m_pos;
+            return true;
+        }
+
+        std::vector<std::size_t> matching;
+        for (;;) {
+            matching.clear();
+            if (!key(active, length, matching)) {
+                return false;
+            }
+            skipSpace();
+            if (m_pos == m_end || *m_pos != ':') {
+                return false;
+            }
+            ++m_pos;
+            skipSpace();
+            if (!(matching.empty() ? skip(depth + 1)
+                                   : value(matching, length + 1, depth + 1))) {
+                return false;
+            }
+            bool closed;
+            if (m_remaining == 0 || !next('}', closed)) {
+                return m_remaining == 0;
+            }
+            if (closed) {
+                return true;
+            }
+        }
+    }
+
+    bool array(const std::vector<std::size_t> &active, std::size_t length,
+        int depth)
+    {
+        ++m_pos;
+        skipSpace();
+        if (m_pos < m_end && *m_pos == ']') {
+            ++m_pos;
+            return true;
+        }
+
+        std::vector<std::size_t> matching;
+        for (std::size_t index = 0;; ++index) {
+            matching.clear();
+            for (auto i : active) {
+                const auto &element = m_paths[i][length];
+                if (element.isIndex && element.index == index) {
+                    matching.push_back(i);
+                }
+            }
+            if (!(matching.empty() ? skip(depth + 1)
+                                   : value(matching, length + 1, depth + 1))) {
+                return false;
+            }
+            bool closed;
+            if (m_remaining == 0 || !next(']', closed)) {
+                return m_remaining == 0;
+            }
+            if (closed) {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Reads the key of an object member and selects the active paths which
+     * continue with it.
+     */
+    bool key(const std::vector<std::size_t> &active, std::size_t length,
+        std::vector<std::size_t> &matching)
+    {
+        if (m_pos == m_end || *m_pos != '"') {
+            return false;
+        }
+
+        const unsigned char *data = m_pos + 1;
+        auto end = findSpecial(data, m_end);
+        std::size_t size = end - data;
+        if (end < m_end && *end == '"') {
+            m_pos = end + 1;
+        }
+        else {
+            // Keys with escapes are rare, so the decoder unescapes them.
+            Decoder decoder{
+                m_env, m_pos, static_cast<std::size_t>(m_end - m_pos)};
+            ERL_NIF_TERM term;
+            ErlNifBinary bin;
+            if (!decoder.decodeValue(term) ||
+                !enif_inspect_binary(m_env, term, &bin)) {
+                return false;
+            }
+            m_pos = decoder.position();
+            data = bin.data;
+            size = bin.size;
+        }
+
+        for (auto i : active) {
+            const auto &element = m_paths[i][length];
+            if (!element.isIndex && element.key.size() == size &&
+                std::memcmp(element.key.data(), data, size) == 0) {
+                matching.push_back(i);
+            }
+        }
+        return true;
+    }
+
+    bool next(unsigned char close, bool &closed)
+    {
+        skipSpace();
+        if (m_pos == m_end || (*m_pos != ',' && *m_pos != close)) {
+            return false;
+        }
+        closed = *m_pos++ == close;
+        if (!closed) {
+            skipSpace();
+        }
+        return true;
+    }
+
+    /**
+     * Moves past a value without decoding it.
+     */
+    bool skip(int depth)
+    {
+        if (m_pos == m_end) {
+            return false;
+        }
+        if (*m_pos == '"') {
+            return skipString();
+        }
+        if (*m_pos != '{' && *m_pos != '[') {
+            auto start = m_pos;
+            while (m_pos < m_end && !isSpace(*m_pos) && *m_pos != ',' &&
+                *m_pos != ']' && *m_pos != '}') {
+                ++m_pos;
+            }
+            return m_pos != start;
+        }
+
+        int level = 0;
+        while (m_pos < m_end) {
+            auto c = *m_pos;
+            if (c == '"') {
+                if (!skipString()) {
+                    return false;
+                }
+                continue;
+            }
+            ++m_pos;
+            if (c == '{' || c == '[') {
+                if (depth + ++level > kMaxDepth) {
+                    return false;
+                }
+            }
+            else if ((c == '}' || c == ']') && --level == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool skipString()
+    {
+        ++m_pos;
+        for (;;) {
+            m_pos = findSpecial(m_pos, m_end);
+            if (m_pos == m_end || *m_pos < 0x20) {
+                return false;
+            }
+            if (*m_pos == '"') {
+                ++m_pos;
+                return true;
+            }
+            if (m_end - m_pos < 2) {
+                return false;
+            }
+            m_pos += 2;
+        }
+    }
+
+    void found(std::size_t i, ERL_NIF_TERM term)
+    {
+        m_values[i] = term;
+        m_found[i] = true;
+        --m_remaining;
+    }
+
+    ErlNifEnv *m_env;
+    const unsigned char *m_pos;
+    const unsigned char *m_end;
+    const std::vector<cb::json::Path> &m_paths;
+    std::vector<ERL_NIF_TERM> &m_values;
+    std::vector<bool> m_found;
+    std::size_t m_remaining;
+};
+} // namespace
+
+namespace cb {
+namespace json {
+
+void load(ErlNifEnv *env)
+{
+    atomTrue = enif_make_atom(env, "true");
+    atomFalse = enif_make_atom(env, "false");
+    atomNull = enif_make_atom(env, "null");
+    atomJson = enif_make_atom(env, "json");
+    atomUndefined = enif_make_atom(env, "undefined");
+}
+
+ERL_NIF_TERM tag() { return atomJson; }
+
+bool decode(ErlNifEnv *env, const unsigned char *data, std::size_t size,
+    ERL_NIF_TERM &term)
+{
+    return Decoder{env, data, size}.decode(term);
+}
+
+bool encode(ErlNifEnv *env, ERL_NIF_TERM term, std::string &buffer)
+{
+    return Encoder{env, buffer}.encode(term, 0);
+}
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, PathElement &var)
+{
+    ErlNifBinary bin;
+    ErlNifUInt64 index;
+    if (enif_inspect_binary(env, term, &bin)) {
+        var.key.assign(reinterpret_cast<const char *>(bin.data), bin.size);
+        var.isIndex = false;
+        return 1;
+    }
+    if (enif_get_uint64(env, term, &index)) {
+        var.index = index;
+        var.isIndex = true;
+        return 1;
+    }
+    return 0;
+}
+
+bool project(ErlNifEnv *env, const unsigned char *data, std::size_t size,
+    const std::vector<Path> &paths, std::vector<ERL_NIF_TERM> &values)
+{
+    return Projector{env, data, size, paths, values}.project();
+}
+
+} // namespace json
+} // namespace cb
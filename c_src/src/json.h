@@ -0,0 +1,74 @@
+/**
+ * @file json.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_JSON_H
+#define COUCHBASE_JSON_H
+
+#include <erl_nif.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace cb {
+namespace json {
+
+/**
+ * Element of a path into a document, which is either the key of an object
+ * member or the index of an array element.
+ */
+struct PathElement {
+    std::string key;
+    std::size_t index = 0;
+    bool isIndex = false;
+};
+
+using Path = std::vector<PathElement>;
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, PathElement &var);
+
+/**
+ * Creates atoms used by the codec. It has to be called when the library is
+ * loaded.
+ */
+void load(ErlNifEnv *env);
+
+/**
+ * Returns the atom tagging terms to be stored as JSON, as in {json, Term}.
+ */
+ERL_NIF_TERM tag();
+
+/**
+ * Decodes a JSON document to the terms jiffy decodes it to: objects become
+ * {[{Key, Value}]}, arrays lists, strings binaries, and true, false and null
+ * atoms. Returns false if the document is not valid JSON.
+ */
+bool decode(ErlNifEnv *env, const unsigned char *data, std::size_t size,
+    ERL_NIF_TERM &term);
+
+/**
+ * Encodes a term accepted by jiffy, appending the document to the buffer.
+ * Objects may be given as {[{Key, Value}]} or maps, with binary or atom
+ * keys. Returns false if the term cannot be encoded.
+ */
+bool encode(ErlNifEnv *env, ERL_NIF_TERM term, std::string &buffer);
+
+/**
+ * Decodes only the values at the paths of a document, as decode does, and
+ * skips the rest of it without making any terms. Values of paths which the
+ * document does not contain are the atom undefined. Scanning stops once all
+ * paths have been found, and skipped values are only checked for balanced
+ * brackets, so the document is not fully validated. Returns false if the
+ * scanned part is not valid JSON.
+ */
+bool project(ErlNifEnv *env, const unsigned char *data, std::size_t size,
+    const std::vector<Path> &paths, std::vector<ERL_NIF_TERM> &values);
+
+} // namespace json
+} // namespace cb
+
+#endif // COUCHBASE_JSON_H
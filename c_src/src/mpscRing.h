@@ -0,0 +1,122 @@
+/**
+ * @file mpscRing.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_MPSC_RING_H
+#define COUCHBASE_MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cb {
+
+/**
+ * Bounded lock-free queue with many producers and a single consumer. Slots
+ * are allocated up front and carry a sequence number telling whether they
+ * are free for the producer of a position or filled for the consumer.
+ */
+template <typename T> class MpscRing {
+public:
+    /**
+     * The capacity is rounded up to a power of two.
+     */
+    explicit MpscRing(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        m_slots.reset(new Slot[size]);
+        m_mask = size - 1;
+        for (std::size_t i = 0; i < size; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing &) = delete;
+
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    ~MpscRing()
+    {
+        consume([](T &&) {});
+    }
+
+    /**
+     * May be called from any thread. Returns false, leaving the value
+     * intact, when the ring is full.
+     */
+    bool push(T &&value)
+    {
+        auto position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            auto &slot = m_slots[position & m_mask];
+            auto sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) -
+                static_cast<std::intptr_t>(position);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed)) {
+                    new (&slot.storage) T(std::move(value));
+                    slot.sequence.store(
+                        position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * May only be called from the consumer thread. Passes values to the
+     * function in the order they were pushed, until reaching one that has
+     * not been published yet.
+     */
+    template <typename F> void consume(F f)
+    {
+        for (;;) {
+            auto &slot = m_slots[m_head & m_mask];
+            if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+                return;
+            }
+
+            auto item = reinterpret_cast<T *>(&slot.storage);
+            f(std::move(*item));
+            item->~T();
+            slot.sequence.store(
+                m_head + m_mask + 1, std::memory_order_release);
+            ++m_head;
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+    };
+
+    // Producers and the consumer write to separate cache lines.
+    std::unique_ptr<Slot[]> m_slots;
+    std::size_t m_mask;
+    char m_producerPad[64];
+    std::atomic<std::size_t> m_tail{0};
+    char m_consumerPad[64];
+    std::size_t m_head = 0;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_MPSC_RING_H
@@ -661,6 +661,23 @@ int register_resource(ErlNifEnv *env, const char *module_str, const char *name,
     }
 }
 
+template <typename T>
+int register_resource(ErlNifEnv *env, const char *name,
+    ErlNifResourceDown *down,
+    ErlNifResourceFlags flags = ErlNifResourceFlags(
+        ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+    ErlNifResourceFlags *tried = nullptr)
+{
+    ErlNifResourceTypeInit init = {};
+    init.dtor = &detail::resource_dtor<T>;
+    init.down = down;
+    ErlNifResourceType *type =
+        enif_open_resource_type_x(env, name, &init, flags, tried);
+
+    detail::resource_data<T>::type = type;
+    return type != nullptr;
+}
+
 template <typename T, typename... Args>
 resource_ptr<T> construct_resource(Args &&... args)
 {
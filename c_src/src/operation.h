@@ -0,0 +1,59 @@
+/**
+ * @file operation.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_OPERATION_H
+#define CBERL_OPERATION_H
+
+#include "types.h"
+
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <utility>
+
+namespace cb {
+
+/**
+ * Tracks a request scheduled on a libcouchbase instance. It is passed as the
+ * command cookie, collects results from libcouchbase callbacks and invokes
+ * the callback when the result for the last command has arrived.
+ */
+template <class ResponseT> class Operation {
+public:
+    using Callback = TrackedCallback<ResponseT>;
+
+    Operation(std::size_t pending, Callback callback)
+        : m_pending{pending}
+        , m_response{LCB_SUCCESS}
+        , m_callback{std::move(callback)}
+    {
+    }
+
+    static Operation *fromCookie(const void *cookie)
+    {
+        return const_cast<Operation *>(static_cast<const Operation *>(cookie));
+    }
+
+    std::size_t pending() const { return m_pending; }
+
+    ResponseT &response() { return m_response; }
+
+    bool complete() { return --m_pending == 0; }
+
+    void finish() { m_callback(m_response); }
+
+    void fail(lcb_error_t err) { m_callback(ResponseT{err}); }
+
+private:
+    std::size_t m_pending;
+    ResponseT m_response;
+    Callback m_callback;
+};
+
+} // namespace cb
+
+#endif // CBERL_OPERATION_H
@@ -0,0 +1,116 @@
+/**
+ * @file qosClass.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "qosClass.h"
+
+#include <algorithm>
+
+namespace cb {
+
+void TokenBucket::setRate(std::size_t rate)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+    m_rate = rate;
+    m_tokens = rate;
+    m_refilled = Clock::now();
+}
+
+bool TokenBucket::ready(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+    refill(now);
+    return m_rate == 0 || m_tokens > 0;
+}
+
+TokenBucket::Clock::time_point TokenBucket::readyAt(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+    refill(now);
+    if (m_rate == 0 || m_tokens > 0) {
+        return now;
+    }
+    // Waits until at least one token is available again.
+    return now +
+        std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>{(1 - m_tokens) / m_rate});
+}
+
+void TokenBucket::take(std::size_t tokens)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+    if (m_rate > 0) {
+        m_tokens -= tokens;
+    }
+}
+
+void TokenBucket::refill(Clock::time_point now)
+{
+    if (m_rate == 0 || now <= m_refilled) {
+        return;
+    }
+    std::chrono::duration<double> elapsed = now - m_refilled;
+    m_tokens = std::min<double>(m_rate, m_tokens + elapsed.count() * m_rate);
+    m_refilled = now;
+}
+
+QosClass::QosClass(std::string name, int priority, std::size_t weight)
+    : m_name{std::move(name)}
+    , m_priority{priority}
+    , m_weight{std::max<std::size_t>(weight, 1)}
+{
+}
+
+const std::string &QosClass::name() const { return m_name; }
+
+void QosClass::configure(int priority, std::size_t weight,
+    std::size_t opsPerSec, std::size_t bytesPerSec)
+{
+    m_priority = priority;
+    m_weight = std::max<std::size_t>(weight, 1);
+    m_ops.setRate(opsPerSec);
+    m_bytes.setRate(bytesPerSec);
+}
+
+int QosClass::priority() const { return m_priority; }
+
+std::size_t QosClass::weight() const { return m_weight; }
+
+bool QosClass::ready(TokenBucket::Clock::time_point now)
+{
+    return m_ops.ready(now) && m_bytes.ready(now);
+}
+
+TokenBucket::Clock::time_point QosClass::readyAt(
+    TokenBucket::Clock::time_point now)
+{
+    return std::max(m_ops.readyAt(now), m_bytes.readyAt(now));
+}
+
+void QosClass::queued() { ++m_queued; }
+
+void QosClass::scheduled(std::size_t ops, std::size_t bytes)
+{
+    m_ops.take(ops);
+    m_bytes.take(bytes);
+    --m_queued;
+    ++m_scheduled;
+}
+
+void QosClass::throttled() { ++m_throttled; }
+
+void QosClass::dropped()
+{
+    --m_queued;
+    ++m_dropped;
+}
+
+QosClass::Stats QosClass::stats() const
+{
+    return {m_queued, m_scheduled, m_throttled, m_dropped};
+}
+
+} // namespace cb
@@ -0,0 +1,103 @@
+/**
+ * @file qosClass.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_QOS_CLASS_H
+#define COUCHBASE_QOS_CLASS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace cb {
+
+/**
+ * Token bucket refilled at a fixed rate per second, holding at most one second
+ * worth of tokens. Tokens may be borrowed while the bucket is not empty, so
+ * that requests larger than the rate can still be scheduled.
+ */
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void setRate(std::size_t rate);
+
+    bool ready(Clock::time_point now);
+
+    Clock::time_point readyAt(Clock::time_point now);
+
+    void take(std::size_t tokens);
+
+private:
+    void refill(Clock::time_point now);
+
+    std::mutex m_mutex;
+    std::size_t m_rate = 0;
+    double m_tokens = 0;
+    Clock::time_point m_refilled;
+};
+
+/**
+ * Named class of requests of all connections sharing a client. Classes of a
+ * lower priority value are scheduled before the others, which are aged so that
+ * they are not starved. Classes of the same priority share worker threads in
+ * proportion to their weights and may be limited in operations and bytes per
+ * second.
+ */
+class QosClass {
+public:
+    struct Stats {
+        std::size_t queued;
+        std::size_t scheduled;
+        std::size_t throttled;
+        std::size_t dropped;
+    };
+
+    QosClass(std::string name, int priority = 0, std::size_t weight = 1);
+
+    const std::string &name() const;
+
+    void configure(int priority, std::size_t weight, std::size_t opsPerSec,
+        std::size_t bytesPerSec);
+
+    int priority() const;
+
+    std::size_t weight() const;
+
+    bool ready(TokenBucket::Clock::time_point now);
+
+    TokenBucket::Clock::time_point readyAt(TokenBucket::Clock::time_point now);
+
+    void queued();
+
+    void scheduled(std::size_t ops, std::size_t bytes);
+
+    void throttled();
+
+    void dropped();
+
+    Stats stats() const;
+
+private:
+    std::string m_name;
+    std::atomic<int> m_priority;
+    std::atomic<std::size_t> m_weight;
+    TokenBucket m_ops;
+    TokenBucket m_bytes;
+    std::atomic<std::size_t> m_queued{0};
+    std::atomic<std::size_t> m_scheduled{0};
+    std::atomic<std::size_t> m_throttled{0};
+    std::atomic<std::size_t> m_dropped{0};
+};
+
+using QosClassPtr = std::shared_ptr<QosClass>;
+
+} // namespace cb
+
+#endif // COUCHBASE_QOS_CLASS_H
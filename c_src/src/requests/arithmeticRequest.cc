@@ -10,7 +10,7 @@
 namespace cb {
 
 ArithmeticRequest::ArithmeticRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
+    : m_key{std::move(std::get<0>(raw))}
     , m_delta{std::get<1>(raw)}
     , m_create{std::get<2>(raw)}
     , m_initial{std::get<3>(raw)}
@@ -11,17 +11,64 @@ namespace cb {
 
 ConnectRequest::ConnectRequest(std::string host, std::string username,
     std::string password, std::string bucket,
-    std::vector<std::tuple<nifpp::str_atom, int>> options)
+    std::vector<std::tuple<nifpp::str_atom, int>> options,
+    std::string configCache)
     : m_host{std::move(host)}
     , m_username{std::move(username)}
     , m_password{std::move(password)}
     , m_bucket{std::move(bucket)}
     , m_options{std::move(options)}
+    , m_configCache{std::move(configCache)}
 {
+    for (const auto &option : m_options) {
+        if (std::get<0>(option) == "shards" && std::get<1>(option) > 0) {
+            m_shards = std::get<1>(option);
+        }
+        else if (std::get<0>(option) == "batch_window" &&
+            std::get<1>(option) > 0) {
+            m_batchWindow = std::chrono::microseconds{std::get<1>(option)};
+        }
+        else if (std::get<0>(option) == "batch_size" &&
+            std::get<1>(option) > 0) {
+            m_batchSize = std::get<1>(option);
+        }
+        else if (std::get<0>(option) == "max_inflight_ops" &&
+            std::get<1>(option) > 0) {
+            m_maxInflightOps = std::get<1>(option);
+        }
+        else if (std::get<0>(option) == "max_inflight_bytes" &&
+            std::get<1>(option) > 0) {
+            m_maxInflightBytes = std::get<1>(option);
+        }
+        else if (std::get<0>(option) == "safe_decode") {
+            m_safeDecode = std::get<1>(option) != 0;
+        }
+        else if (std::get<0>(option) == "compression_threshold" &&
+            std::get<1>(option) >= 0) {
+            m_compressionThreshold = std::get<1>(option);
+        }
+    }
 }
 
 const std::string &ConnectRequest::host() const { return m_host; }
 
+std::vector<std::string> ConnectRequest::seeds() const
+{
+    std::vector<std::string> seeds;
+    std::size_t begin = 0;
+    while (begin <= m_host.size()) {
+        auto end = m_host.find_first_of(",;", begin);
+        if (end == std::string::npos) {
+            end = m_host.size();
+        }
+        if (end > begin) {
+            seeds.emplace_back(m_host.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return seeds;
+}
+
 const std::string &ConnectRequest::username() const { return m_username; }
 
 const std::string &ConnectRequest::password() const { return m_password; }
@@ -34,4 +81,36 @@ ConnectRequest::options() const
     return m_options;
 }
 
+std::string ConnectRequest::configCache(std::size_t shard) const
+{
+    // Each libcouchbase instance writes its own cache file.
+    if (m_configCache.empty() || m_shards == 1) {
+        return m_configCache;
+    }
+    return m_configCache + "." + std::to_string(shard);
+}
+
+std::size_t ConnectRequest::shards() const { return m_shards; }
+
+std::chrono::microseconds ConnectRequest::batchWindow() const
+{
+    return m_batchWindow;
+}
+
+std::size_t ConnectRequest::batchSize() const { return m_batchSize; }
+
+std::size_t ConnectRequest::maxInflightOps() const { return m_maxInflightOps; }
+
+std::size_t ConnectRequest::maxInflightBytes() const
+{
+    return m_maxInflightBytes;
+}
+
+bool ConnectRequest::safeDecode() const { return m_safeDecode; }
+
+std::size_t ConnectRequest::compressionThreshold() const
+{
+    return m_compressionThreshold;
+}
+
 } // namespace cb
@@ -12,6 +12,7 @@
 
 #include <libcouchbase/couchbase.h>
 
+#include <chrono>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -22,10 +23,16 @@ class ConnectRequest {
 public:
     ConnectRequest(std::string host, std::string username, std::string password,
         std::string bucket,
-        std::vector<std::tuple<nifpp::str_atom, int>> options);
+        std::vector<std::tuple<nifpp::str_atom, int>> options,
+        std::string configCache = {});
 
     const std::string &host() const;
 
+    /**
+     * Returns hosts listed in the host string, separated by ',' or ';'.
+     */
+    std::vector<std::string> seeds() const;
+
     const std::string &username() const;
 
     const std::string &password() const;
@@ -34,12 +41,40 @@ public:
 
     const std::vector<std::tuple<nifpp::str_atom, int>> &options() const;
 
+    /**
+     * Returns path of the cluster map cache file of a shard, or an empty
+     * string if the cache is disabled.
+     */
+    std::string configCache(std::size_t shard) const;
+
+    std::size_t shards() const;
+
+    std::chrono::microseconds batchWindow() const;
+
+    std::size_t batchSize() const;
+
+    std::size_t maxInflightOps() const;
+
+    std::size_t maxInflightBytes() const;
+
+    bool safeDecode() const;
+
+    std::size_t compressionThreshold() const;
+
 private:
     std::string m_host;
     std::string m_username;
     std::string m_password;
     std::string m_bucket;
     std::vector<std::tuple<nifpp::str_atom, int>> m_options;
+    std::string m_configCache;
+    std::size_t m_shards = 1;
+    std::chrono::microseconds m_batchWindow{0};
+    std::size_t m_batchSize = 128;
+    std::size_t m_maxInflightOps = 0;
+    std::size_t m_maxInflightBytes = 0;
+    bool m_safeDecode = false;
+    std::size_t m_compressionThreshold = 1024;
 };
 
 } // namespace cb
@@ -10,7 +10,7 @@
 namespace cb {
 
 DurabilityRequest::DurabilityRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
+    : m_key{std::move(std::get<0>(raw))}
     , m_cas{std::get<1>(raw)}
 {
 }
@@ -10,7 +10,7 @@
 namespace cb {
 
 GetRequest::GetRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
+    : m_key{std::move(std::get<0>(raw))}
     , m_expiry{std::get<1>(raw)}
     , m_lock{std::get<2>(raw)}
 {
@@ -12,9 +12,9 @@ namespace cb {
 HttpRequest::HttpRequest(Raw raw)
     : m_type{static_cast<lcb_http_type_t>(std::get<0>(raw))}
     , m_method{static_cast<lcb_http_method_t>(std::get<1>(raw))}
-    , m_path{std::get<2>(raw)}
-    , m_contentType{std::get<3>(raw)}
-    , m_body{std::get<4>(raw)}
+    , m_path{std::move(std::get<2>(raw))}
+    , m_contentType{std::move(std::get<3>(raw))}
+    , m_body{std::move(std::get<4>(raw))}
 {
 }
 
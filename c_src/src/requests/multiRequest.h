@@ -8,20 +8,52 @@
 #ifndef CBERL_MULTI_REQUEST_H
 #define CBERL_MULTI_REQUEST_H
 
+#include "arena.h"
+#include "nifpp.h"
+
 #include <vector>
 
 namespace cb {
 
 template <class RequestT> class MultiRequest {
 public:
-    MultiRequest(std::vector<typename RequestT::Raw> rawRequests)
+    MultiRequest() = default;
+
+    void add(RequestT request) { m_requests.emplace_back(std::move(request)); }
+
+    void reserve(std::size_t size) { m_requests.reserve(size); }
+
+    const std::vector<RequestT> &requests() const { return m_requests; }
+
+    std::vector<RequestT> &requests() { return m_requests; }
+
+    /**
+     * Decodes a list of raw requests in a single pass, constructing each
+     * request in place from its raw tuple. All requests of the list share
+     * one arena.
+     */
+    friend int get(ErlNifEnv *env, ERL_NIF_TERM term, MultiRequest &var)
     {
-        for (auto &rawRequest : rawRequests) {
-            m_requests.emplace_back(std::move(rawRequest));
+        unsigned int length;
+        if (!enif_get_list_length(env, term, &length)) {
+            return 0;
         }
-    }
 
-    const std::vector<RequestT> &requests() const { return m_requests; }
+        var.m_requests.clear();
+        var.m_requests.reserve(length);
+
+        Arena::Scope scope;
+
+        typename RequestT::Raw raw;
+        ERL_NIF_TERM head, tail = term;
+        while (enif_get_list_cell(env, tail, &head, &tail)) {
+            if (!nifpp::get(env, head, raw)) {
+                return 0;
+            }
+            var.m_requests.emplace_back(std::move(raw));
+        }
+        return 1;
+    }
 
 private:
     std::vector<RequestT> m_requests;
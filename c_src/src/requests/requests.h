@@ -16,5 +16,6 @@
 #include "multiRequest.h"
 #include "removeRequest.h"
 #include "storeRequest.h"
+#include "value.h"
 
 #endif // CBERL_REQUESTS_H
@@ -8,6 +8,8 @@
 #ifndef CBERL_STORE_REQUEST_H
 #define CBERL_STORE_REQUEST_H
 
+#include "value.h"
+
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,8 +19,8 @@ namespace cb {
 
 class StoreRequest {
 public:
-    using Raw = std::tuple<int, std::string, std::string, lcb_uint32_t,
-        lcb_cas_t, lcb_time_t>;
+    using Raw = std::tuple<int, std::string, Value, lcb_uint32_t, lcb_cas_t,
+        lcb_time_t>;
 
     StoreRequest(Raw raw);
 
@@ -26,7 +28,7 @@ public:
 
     const std::string &key() const;
 
-    const std::string &value() const;
+    const Value &value() const;
 
     lcb_uint32_t flags() const;
 
@@ -37,7 +39,7 @@ public:
 private:
     lcb_storage_t m_operation;
     std::string m_key;
-    std::string m_value;
+    Value m_value;
     lcb_uint32_t m_flags;
     lcb_cas_t m_cas;
     lcb_time_t m_expiry;
@@ -0,0 +1,151 @@
+/**
+ * @file value.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "value.h"
+#include "json.h"
+
+#include <cstring>
+#include <string>
+
+namespace {
+constexpr std::size_t kMaxJsonBuffer = 1 << 20;
+
+/**
+ * Returns the term of a {json, Term} value.
+ */
+bool jsonTerm(ErlNifEnv *env, ERL_NIF_TERM term, ERL_NIF_TERM &json)
+{
+    int arity;
+    const ERL_NIF_TERM *elements;
+    if (!enif_get_tuple(env, term, &arity, &elements) || arity != 2 ||
+        !enif_is_identical(elements[0], cb::json::tag())) {
+        return false;
+    }
+    json = elements[1];
+    return true;
+}
+
+/**
+ * Returns the method and the value of a {compressed, Codec, Value} value.
+ */
+bool compressedTerm(ErlNifEnv *env, ERL_NIF_TERM term,
+    cb::compression::Method &method, ERL_NIF_TERM &value)
+{
+    int arity;
+    const ERL_NIF_TERM *elements;
+    char tag[sizeof("compressed")];
+    if (!enif_get_tuple(env, term, &arity, &elements) || arity != 3 ||
+        !enif_get_atom(env, elements[0], tag, sizeof(tag), ERL_NIF_LATIN1) ||
+        std::strcmp(tag, "compressed") != 0 ||
+        !cb::compression::get(env, elements[1], method)) {
+        return false;
+    }
+    value = elements[2];
+    return true;
+}
+} // namespace
+
+namespace cb {
+
+std::size_t Value::size() const { return m_size; }
+
+const Value::Segments &Value::segments() const { return m_segments; }
+
+const compression::Method &Value::compression() const
+{
+    return m_compression;
+}
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, Value &var)
+{
+    // Values of a bulk request are decoded into the same variable, which
+    // must not keep the method of the previous one.
+    var.m_compression = {};
+
+    compression::Method method;
+    ERL_NIF_TERM inner;
+    if (compressedTerm(env, term, method, inner)) {
+        if (!get(env, inner, var)) {
+            return 0;
+        }
+        // Codecs the library has been built without leave values as they
+        // are, as the flags tell readers that they are not compressed.
+        if (compression::available(method.codec)) {
+            var.m_compression = method;
+        }
+        return 1;
+    }
+
+    auto arena = Arena::acquire();
+
+    ERL_NIF_TERM json;
+    if (jsonTerm(env, term, json)) {
+        // Documents are encoded to a buffer reused by the thread and copied
+        // to the arena, which keeps them until the batch is sent.
+        thread_local std::string buffer;
+        buffer.clear();
+        if (buffer.capacity() > kMaxJsonBuffer) {
+            buffer.shrink_to_fit();
+        }
+        if (!json::encode(env, json, buffer)) {
+            return 0;
+        }
+        auto data = arena->allocate(buffer.size(), 1);
+        std::memcpy(data, buffer.data(), buffer.size());
+        Value::Segments segments{ArenaAllocator<lcb_IOV>{arena}};
+        segments.push_back(lcb_IOV{data, buffer.size()});
+        var.m_segments = std::move(segments);
+        var.m_size = buffer.size();
+        return 1;
+    }
+
+    auto valueEnv = arena->env();
+    auto copy = enif_make_copy(valueEnv, term);
+
+    Value::Segments segments{ArenaAllocator<lcb_IOV>{arena}};
+    std::size_t size = 0;
+    std::vector<ERL_NIF_TERM, ArenaAllocator<ERL_NIF_TERM>> terms{
+        {copy}, ArenaAllocator<ERL_NIF_TERM>{arena}};
+    bool flatten = false;
+
+    while (!terms.empty() && !flatten) {
+        auto next = terms.back();
+        terms.pop_back();
+
+        ErlNifBinary bin;
+        ERL_NIF_TERM head, tail;
+        if (enif_inspect_binary(valueEnv, next, &bin)) {
+            if (bin.size > 0) {
+                segments.push_back(lcb_IOV{bin.data, bin.size});
+                size += bin.size;
+            }
+        }
+        else if (enif_get_list_cell(valueEnv, next, &head, &tail)) {
+            terms.push_back(tail);
+            terms.push_back(head);
+        }
+        else if (!enif_is_empty_list(valueEnv, next)) {
+            // Bytes given as integers have no binary to refer to.
+            flatten = true;
+        }
+    }
+
+    if (flatten) {
+        ErlNifBinary bin;
+        if (!enif_inspect_iolist_as_binary(valueEnv, copy, &bin)) {
+            return 0;
+        }
+        segments.assign(1, lcb_IOV{bin.data, bin.size});
+        size = bin.size;
+    }
+
+    var.m_segments = std::move(segments);
+    var.m_size = size;
+    return 1;
+}
+
+} // namespace cb
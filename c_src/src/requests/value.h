@@ -0,0 +1,53 @@
+/**
+ * @file value.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_VALUE_H
+#define CBERL_VALUE_H
+
+#include "arena.h"
+#include "compression.h"
+#include "nifpp.h"
+
+#include <libcouchbase/couchbase.h>
+
+#include <memory>
+#include <vector>
+
+namespace cb {
+
+/**
+ * Value of a request referring to the binaries of an Erlang iodata term. The
+ * term is copied to the environment of the batch arena, which shares refc
+ * binaries with the caller instead of copying their data, and each binary
+ * of the iodata becomes a separate segment. A {json, Term} value is encoded
+ * to a single segment instead. A {compressed, Codec, Value} value is
+ * compressed with the codec when it is scheduled, where Codec may be
+ * {zstd, Id} to compress it with a loaded dictionary.
+ */
+class Value {
+public:
+    using Segments = std::vector<lcb_IOV, ArenaAllocator<lcb_IOV>>;
+
+    std::size_t size() const;
+
+    const Segments &segments() const;
+
+    const compression::Method &compression() const;
+
+    friend int get(ErlNifEnv *env, ERL_NIF_TERM term, Value &var);
+
+private:
+    Segments m_segments;
+    std::size_t m_size = 0;
+    compression::Method m_compression;
+};
+
+int get(ErlNifEnv *env, ERL_NIF_TERM term, Value &var);
+
+} // namespace cb
+
+#endif // CBERL_VALUE_H
@@ -25,12 +25,14 @@ ArithmeticResponse::ArithmeticResponse(
 {
 }
 
+const std::string &ArithmeticResponse::key() const { return m_key; }
+
 nifpp::TERM ArithmeticResponse::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(env,
             std::make_tuple(
-                m_key, std::make_tuple(nifpp::str_atom{"ok"}, m_cas, m_value)));
+                m_key, std::make_tuple(okAtom(), m_cas, m_value)));
     }
 
     return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
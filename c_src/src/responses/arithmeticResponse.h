@@ -19,6 +19,8 @@ public:
     ArithmeticResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
         std::uint64_t value);
 
+    const std::string &key() const;
+
     nifpp::TERM toTerm(const Env &env) const;
 
 private:
@@ -29,7 +29,7 @@ nifpp::TERM DurabilityResponse::toTerm(const Env &env) const
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(env,
             std::make_tuple(
-                m_key, std::make_tuple(nifpp::str_atom{"ok"}, m_cas)));
+                m_key, std::make_tuple(okAtom(), m_cas)));
     }
 
     return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
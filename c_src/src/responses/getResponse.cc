@@ -7,6 +7,13 @@
 
 #include "getResponse.h"
 
+#include <cstring>
+
+namespace {
+constexpr lcb_uint32_t kJsonFlags = 1;
+constexpr lcb_uint32_t kTermFlags = 2;
+} // namespace
+
 namespace cb {
 
 GetResponse::GetResponse(lcb_error_t err, const void *key, std::size_t keySize)
@@ -21,20 +28,121 @@ GetResponse::GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
     , m_key{static_cast<const char *>(key), keySize}
     , m_cas{cas}
     , m_flags{flags}
-    , m_value{static_cast<const char *>(value), valueSize}
+    , m_value{value, valueSize}
 {
 }
 
-nifpp::TERM GetResponse::toTerm(const Env &env) const
+const std::string &GetResponse::key() const { return m_key; }
+
+nifpp::TERM GetResponse::toTerm(const Env &env, bool safe) const
+{
+    if (m_err != LCB_SUCCESS) {
+        return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
+    }
+
+    compression::Buffer buffer{0};
+    const unsigned char *data;
+    std::size_t size;
+    if (!decompress(buffer, data, size)) {
+        return nifpp::make(
+            env, std::make_tuple(m_key, decompressionError(env)));
+    }
+
+    // JSON documents and Erlang terms are decoded here, on the io thread, so
+    // that the caller receives terms instead of a binary to parse.
+    ERL_NIF_TERM value;
+    auto format = compression::format(m_flags);
+    if (format == kJsonFlags) {
+        if (!json::decode(env, data, size, value)) {
+            return nifpp::make(env, std::make_tuple(m_key, invalidJson(env)));
+        }
+    }
+    else if (format == kTermFlags) {
+        auto options = safe ? ERL_NIF_BIN2TERM_SAFE : ErlNifBinaryToTerm{};
+        if (enif_binary_to_term(env, data, size, &value, options) == 0) {
+            return nifpp::make(env, std::make_tuple(m_key, invalidTerm(env)));
+        }
+    }
+    else {
+        value = binary(env, data, size);
+    }
+    return ok(env, value);
+}
+
+nifpp::TERM GetResponse::toTerm(
+    const Env &env, const std::vector<json::Path> &paths) const
 {
-    if (m_err == LCB_SUCCESS) {
-        return nifpp::make(env,
-            std::make_tuple(m_key,
-                std::make_tuple(
-                    nifpp::str_atom{"ok"}, m_cas, m_flags, m_value)));
+    if (m_err != LCB_SUCCESS) {
+        return toTerm(env);
     }
 
-    return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
+    compression::Buffer buffer{0};
+    const unsigned char *data;
+    std::size_t size;
+    if (!decompress(buffer, data, size)) {
+        return nifpp::make(
+            env, std::make_tuple(m_key, decompressionError(env)));
+    }
+    if (compression::format(m_flags) != kJsonFlags) {
+        return ok(env, binary(env, data, size));
+    }
+
+    std::vector<ERL_NIF_TERM> values;
+    if (!json::project(env, data, size, paths, values)) {
+        return nifpp::make(env, std::make_tuple(m_key, invalidJson(env)));
+    }
+    return ok(
+        env, enif_make_list_from_array(env, values.data(), values.size()));
+}
+
+bool GetResponse::decompress(compression::Buffer &buffer,
+    const unsigned char *&data, std::size_t &size) const
+{
+    auto method = compression::method(m_flags);
+    if (method.codec == compression::Codec::none) {
+        data = m_value.data();
+        size = m_value.size();
+        return true;
+    }
+
+    if (!compression::decompress(
+            method, m_value.data(), m_value.size(), buffer)) {
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+nifpp::TERM GetResponse::decompressionError(const Env &env) const
+{
+    auto method = compression::method(m_flags);
+    if (method.dictionary != 0 && compression::available(method.codec) &&
+        !compression::loaded(method.dictionary)) {
+        return unknownDictionary(env, method.dictionary);
+    }
+    return invalidCompression(env);
+}
+
+ERL_NIF_TERM GetResponse::binary(
+    const Env &env, const unsigned char *data, std::size_t size) const
+{
+    // Values which have not been decompressed are shared with the caller.
+    if (data == m_value.data()) {
+        return m_value.toTerm(env);
+    }
+
+    ERL_NIF_TERM term;
+    std::memcpy(enif_make_new_binary(env, size, &term), data, size);
+    return term;
+}
+
+nifpp::TERM GetResponse::ok(const Env &env, ERL_NIF_TERM value) const
+{
+    return nifpp::make(env,
+        std::make_tuple(m_key,
+            std::make_tuple(okAtom(), m_cas, compression::format(m_flags),
+                nifpp::TERM{value})));
 }
 
 } // namespace cb
@@ -8,7 +8,12 @@
 #ifndef CBERL_GET_RESPONSE_H
 #define CBERL_GET_RESPONSE_H
 
+#include "compression.h"
+#include "json.h"
 #include "response.h"
+#include "sharedBinary.h"
+
+#include <vector>
 
 namespace cb {
 
@@ -19,13 +24,45 @@ public:
     GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
         lcb_uint32_t flags, const void *value, std::size_t valueSize);
 
-    nifpp::TERM toTerm(const Env &env) const;
+    const std::string &key() const;
+
+    /**
+     * Builds the reply, decoding values stored as Erlang terms in the safe
+     * mode of binary_to_term if requested.
+     */
+    nifpp::TERM toTerm(const Env &env, bool safe = false) const;
+
+    /**
+     * Builds the reply with only the values at the paths of a JSON document,
+     * in place of the whole value. Values not stored as JSON are returned as
+     * binaries.
+     */
+    nifpp::TERM toTerm(
+        const Env &env, const std::vector<json::Path> &paths) const;
 
 private:
+    /**
+     * Returns the bytes of the value, decompressed to the buffer if it has
+     * been stored compressed.
+     */
+    bool decompress(compression::Buffer &buffer, const unsigned char *&data,
+        std::size_t &size) const;
+
+    /**
+     * Returns the error of a value which cannot be decompressed, telling
+     * apart values compressed with a dictionary which has not been loaded.
+     */
+    nifpp::TERM decompressionError(const Env &env) const;
+
+    ERL_NIF_TERM binary(
+        const Env &env, const unsigned char *data, std::size_t size) const;
+
+    nifpp::TERM ok(const Env &env, ERL_NIF_TERM value) const;
+
     std::string m_key;
     lcb_cas_t m_cas;
     lcb_uint32_t m_flags;
-    std::string m_value;
+    SharedBinary m_value;
 };
 
 } // namespace cb
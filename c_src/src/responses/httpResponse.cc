@@ -29,7 +29,7 @@ nifpp::TERM HttpResponse::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, m_status, m_body));
+            env, std::make_tuple(okAtom(), m_status, m_body));
     }
 
     return Response::toTerm(env);
@@ -26,15 +26,36 @@ public:
         m_responses.emplace_back(std::move(response));
     }
 
-    nifpp::TERM toTerm(const Env &env) const
+    void reserve(std::size_t size) { m_responses.reserve(size); }
+
+    void merge(const MultiResponse &response)
+    {
+        if (m_err == LCB_SUCCESS) {
+            m_err = response.m_err;
+        }
+        m_responses.insert(m_responses.end(), response.m_responses.begin(),
+            response.m_responses.end());
+    }
+
+    const std::vector<ResponseT> &responses() const { return m_responses; }
+
+    /**
+     * Builds the reply of all responses, passing the arguments on to each of
+     * them.
+     */
+    template <typename... Args>
+    nifpp::TERM toTerm(const Env &env, const Args &... args) const
     {
         if (m_err == LCB_SUCCESS) {
-            std::vector<nifpp::TERM> terms;
+            std::vector<ERL_NIF_TERM> terms;
+            terms.reserve(m_responses.size());
             for (const auto &response : m_responses) {
-                terms.emplace_back(response.toTerm(env));
+                terms.emplace_back(response.toTerm(env, args...));
             }
-            return nifpp::make(
-                env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(terms)));
+            return nifpp::make(env,
+                std::make_tuple(okAtom(),
+                    nifpp::TERM{enif_make_list_from_array(
+                        env, terms.data(), terms.size())}));
         }
 
         return Response::toTerm(env);
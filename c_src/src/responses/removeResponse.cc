@@ -16,10 +16,12 @@ RemoveResponse::RemoveResponse(
 {
 }
 
+const std::string &RemoveResponse::key() const { return m_key; }
+
 nifpp::TERM RemoveResponse::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
-        return nifpp::make(env, std::make_tuple(m_key, nifpp::str_atom{"ok"}));
+        return nifpp::make(env, std::make_tuple(m_key, okAtom()));
     }
 
     return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
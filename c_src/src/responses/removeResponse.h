@@ -16,6 +16,8 @@ class RemoveResponse : public Response {
 public:
     RemoveResponse(lcb_error_t err, const void *key, std::size_t keySize);
 
+    const std::string &key() const;
+
     nifpp::TERM toTerm(const Env &env) const;
 
 private:
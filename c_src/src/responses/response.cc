@@ -7,6 +7,39 @@
 
 #include "response.h"
 
+namespace {
+struct ErrorAtom {
+    lcb_error_t err;
+    const char *name;
+    ERL_NIF_TERM atom;
+};
+
+ErrorAtom errorAtoms[] = {{LCB_AUTH_CONTINUE, "auth_continue", 0},
+    {LCB_AUTH_ERROR, "auth_error", 0}, {LCB_DELTA_BADVAL, "delta_badval", 0},
+    {LCB_E2BIG, "e2big", 0}, {LCB_EBUSY, "ebusy", 0},
+    {LCB_EINTERNAL, "einternal", 0}, {LCB_EINVAL, "einval", 0},
+    {LCB_ENOMEM, "enomem", 0}, {LCB_ERANGE, "erange", 0},
+    {LCB_ERROR, "error", 0}, {LCB_ETMPFAIL, "etmpfail", 0},
+    {LCB_KEY_EEXISTS, "key_eexists", 0}, {LCB_KEY_ENOENT, "key_enoent", 0},
+    {LCB_NETWORK_ERROR, "network_error", 0},
+    {LCB_NOT_MY_VBUCKET, "not_my_vbucket", 0},
+    {LCB_NOT_STORED, "not_stored", 0}, {LCB_NOT_SUPPORTED, "not_supported", 0},
+    {LCB_UNKNOWN_COMMAND, "unknown_command", 0},
+    {LCB_UNKNOWN_HOST, "unknown_host", 0},
+    {LCB_PROTOCOL_ERROR, "protocol_error", 0},
+    {LCB_ETIMEDOUT, "etimedout", 0}, {LCB_CONNECT_ERROR, "connect_error", 0},
+    {LCB_BUCKET_ENOENT, "bucket_enoent", 0},
+    {LCB_CLIENT_ENOMEM, "client_enomem", 0}};
+
+ERL_NIF_TERM ok;
+ERL_NIF_TERM error;
+ERL_NIF_TERM unknownError;
+ERL_NIF_TERM invalidJsonAtom;
+ERL_NIF_TERM invalidTermAtom;
+ERL_NIF_TERM invalidCompressionAtom;
+ERL_NIF_TERM unknownDictionaryAtom;
+} // namespace
+
 namespace cb {
 
 Response::Response(lcb_error_t err)
@@ -14,71 +47,62 @@ Response::Response(lcb_error_t err)
 {
 }
 
+lcb_error_t Response::err() const { return m_err; }
+
 nifpp::TERM Response::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
-        return nifpp::make(env, nifpp::str_atom{"ok"});
+        return okAtom();
     }
 
-    return nifpp::make(env,
-        std::make_tuple(
-            nifpp::str_atom{"error"}, nifpp::str_atom{errorMessage()}));
+    return nifpp::TERM{enif_make_tuple2(env, error, errorAtom())};
+}
+
+void Response::loadAtoms(ErlNifEnv *env)
+{
+    ok = enif_make_atom(env, "ok");
+    error = enif_make_atom(env, "error");
+    unknownError = enif_make_atom(env, "unknown_error");
+    invalidJsonAtom = enif_make_atom(env, "invalid_json");
+    invalidTermAtom = enif_make_atom(env, "invalid_term");
+    invalidCompressionAtom = enif_make_atom(env, "invalid_compression");
+    unknownDictionaryAtom = enif_make_atom(env, "unknown_dictionary");
+    for (auto &errorAtom : errorAtoms) {
+        errorAtom.atom = enif_make_atom(env, errorAtom.name);
+    }
+}
+
+nifpp::TERM Response::okAtom() { return nifpp::TERM{ok}; }
+
+nifpp::TERM Response::invalidJson(const Env &env)
+{
+    return nifpp::TERM{enif_make_tuple2(env, error, invalidJsonAtom)};
+}
+
+nifpp::TERM Response::invalidTerm(const Env &env)
+{
+    return nifpp::TERM{enif_make_tuple2(env, error, invalidTermAtom)};
+}
+
+nifpp::TERM Response::invalidCompression(const Env &env)
+{
+    return nifpp::TERM{enif_make_tuple2(env, error, invalidCompressionAtom)};
+}
+
+nifpp::TERM Response::unknownDictionary(const Env &env, std::uint16_t id)
+{
+    return nifpp::TERM{enif_make_tuple2(env, error,
+        enif_make_tuple2(env, unknownDictionaryAtom, enif_make_uint(env, id)))};
 }
 
-std::string Response::errorMessage() const
+nifpp::TERM Response::errorAtom() const
 {
-    switch (m_err) {
-        case LCB_AUTH_CONTINUE:
-            return "auth_continue";
-        case LCB_AUTH_ERROR:
-            return "auth_error";
-        case LCB_DELTA_BADVAL:
-            return "delta_badval";
-        case LCB_E2BIG:
-            return "e2big";
-        case LCB_EBUSY:
-            return "ebusy";
-        case LCB_EINTERNAL:
-            return "einternal";
-        case LCB_EINVAL:
-            return "einval";
-        case LCB_ENOMEM:
-            return "enomem";
-        case LCB_ERANGE:
-            return "erange";
-        case LCB_ERROR:
-            return "error";
-        case LCB_ETMPFAIL:
-            return "etmpfail";
-        case LCB_KEY_EEXISTS:
-            return "key_eexists";
-        case LCB_KEY_ENOENT:
-            return "key_enoent";
-        case LCB_NETWORK_ERROR:
-            return "network_error";
-        case LCB_NOT_MY_VBUCKET:
-            return "not_my_vbucket";
-        case LCB_NOT_STORED:
-            return "not_stored";
-        case LCB_NOT_SUPPORTED:
-            return "not_supported";
-        case LCB_UNKNOWN_COMMAND:
-            return "unknown_command";
-        case LCB_UNKNOWN_HOST:
-            return "unknown_host";
-        case LCB_PROTOCOL_ERROR:
-            return "protocol_error";
-        case LCB_ETIMEDOUT:
-            return "etimedout";
-        case LCB_CONNECT_ERROR:
-            return "connect_error";
-        case LCB_BUCKET_ENOENT:
-            return "bucket_enoent";
-        case LCB_CLIENT_ENOMEM:
-            return "client_enomem";
-        default:
-            return "unknown_error";
+    for (const auto &errorAtom : errorAtoms) {
+        if (errorAtom.err == m_err) {
+            return nifpp::TERM{errorAtom.atom};
+        }
     }
+    return nifpp::TERM{unknownError};
 }
 
 } // namespace cb
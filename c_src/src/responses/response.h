@@ -12,22 +12,34 @@
 
 #include <libcouchbase/couchbase.h>
 
-#include <memory>
+#include <cstdint>
 #include <string>
 
+/**
+ * Process independent environment replies are built in. Environments are
+ * reused for the messages of later replies once they have been cleared.
+ */
 class Env {
 public:
     Env()
-        : m_env{enif_alloc_env(), enif_free_env}
+        : m_env{enif_alloc_env()}
     {
     }
 
-    operator ErlNifEnv *() const { return m_env.get(); }
+    Env(const Env &) = delete;
+
+    Env &operator=(const Env &) = delete;
+
+    ~Env() { enif_free_env(m_env); }
 
-    ErlNifEnv *get() const { return m_env.get(); }
+    void clear() { enif_clear_env(m_env); }
+
+    operator ErlNifEnv *() const { return m_env; }
+
+    ErlNifEnv *get() const { return m_env; }
 
 private:
-    std::shared_ptr<ErlNifEnv> m_env;
+    ErlNifEnv *m_env;
 };
 
 namespace cb {
@@ -36,13 +48,47 @@ class Response {
 public:
     Response(lcb_error_t err = LCB_SUCCESS);
 
+    lcb_error_t err() const;
+
     nifpp::TERM toTerm(const Env &env) const;
 
+    /**
+     * Creates atoms of replies once, so that building a reply does not look
+     * them up in the atom table.
+     */
+    static void loadAtoms(ErlNifEnv *env);
+
 protected:
+    static nifpp::TERM okAtom();
+
+    /**
+     * Returns {error, invalid_json}, the result of a value stored as JSON
+     * which cannot be decoded.
+     */
+    static nifpp::TERM invalidJson(const Env &env);
+
+    /**
+     * Returns {error, invalid_term}, the result of a value stored as an Erlang
+     * term which cannot be decoded.
+     */
+    static nifpp::TERM invalidTerm(const Env &env);
+
+    /**
+     * Returns {error, invalid_compression}, the result of a compressed value
+     * which cannot be decompressed.
+     */
+    static nifpp::TERM invalidCompression(const Env &env);
+
+    /**
+     * Returns {error, {unknown_dictionary, Id}}, the result of a value
+     * compressed with a dictionary which has not been loaded.
+     */
+    static nifpp::TERM unknownDictionary(const Env &env, std::uint16_t id);
+
     lcb_error_t m_err;
 
 private:
-    std::string errorMessage() const;
+    nifpp::TERM errorAtom() const;
 };
 
 } // namespace cb
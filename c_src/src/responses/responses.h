@@ -15,6 +15,7 @@
 #include "httpResponse.h"
 #include "multiResponse.h"
 #include "removeResponse.h"
+#include "sharedBinary.h"
 #include "storeResponse.h"
 
 #endif // CBERL_RESPONSES_H
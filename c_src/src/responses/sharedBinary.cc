@@ -0,0 +1,75 @@
+/**
+ * @file sharedBinary.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "sharedBinary.h"
+
+#include <cstring>
+#include <utility>
+
+namespace cb {
+
+ErlNifResourceType *SharedBinary::s_type = nullptr;
+
+SharedBinary::SharedBinary(const void *data, std::size_t size)
+    : m_size{size}
+{
+    if (size > 0) {
+        m_resource = enif_alloc_resource(s_type, size);
+        std::memcpy(m_resource, data, size);
+    }
+}
+
+SharedBinary::SharedBinary(const SharedBinary &other)
+    : m_resource{other.m_resource}
+    , m_size{other.m_size}
+{
+    if (m_resource) {
+        enif_keep_resource(m_resource);
+    }
+}
+
+SharedBinary &SharedBinary::operator=(SharedBinary other)
+{
+    std::swap(m_resource, other.m_resource);
+    std::swap(m_size, other.m_size);
+    return *this;
+}
+
+SharedBinary::~SharedBinary()
+{
+    if (m_resource) {
+        enif_release_resource(m_resource);
+    }
+}
+
+bool SharedBinary::registerType(ErlNifEnv *env)
+{
+    s_type = enif_open_resource_type(env, nullptr, "SharedBinary", nullptr,
+        ErlNifResourceFlags(ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+        nullptr);
+    return s_type != nullptr;
+}
+
+const unsigned char *SharedBinary::data() const
+{
+    return static_cast<const unsigned char *>(m_resource);
+}
+
+std::size_t SharedBinary::size() const { return m_size; }
+
+nifpp::TERM SharedBinary::toTerm(ErlNifEnv *env) const
+{
+    if (!m_resource) {
+        ERL_NIF_TERM term;
+        enif_make_new_binary(env, 0, &term);
+        return nifpp::TERM{term};
+    }
+    return nifpp::TERM{
+        enif_make_resource_binary(env, m_resource, m_resource, m_size)};
+}
+
+} // namespace cb
@@ -0,0 +1,51 @@
+/**
+ * @file sharedBinary.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_SHARED_BINARY_H
+#define CBERL_SHARED_BINARY_H
+
+#include "nifpp.h"
+
+#include <cstddef>
+
+namespace cb {
+
+/**
+ * Bytes held by a NIF resource, which Erlang binaries of any number of
+ * environments refer to without copying them. Data is copied only once, when
+ * the binary is created.
+ */
+class SharedBinary {
+public:
+    SharedBinary() = default;
+
+    SharedBinary(const void *data, std::size_t size);
+
+    SharedBinary(const SharedBinary &other);
+
+    SharedBinary &operator=(SharedBinary other);
+
+    ~SharedBinary();
+
+    static bool registerType(ErlNifEnv *env);
+
+    const unsigned char *data() const;
+
+    std::size_t size() const;
+
+    nifpp::TERM toTerm(ErlNifEnv *env) const;
+
+private:
+    static ErlNifResourceType *s_type;
+
+    void *m_resource = nullptr;
+    std::size_t m_size = 0;
+};
+
+} // namespace cb
+
+#endif // CBERL_SHARED_BINARY_H
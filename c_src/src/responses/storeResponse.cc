@@ -24,12 +24,14 @@ StoreResponse::StoreResponse(
 {
 }
 
+const std::string &StoreResponse::key() const { return m_key; }
+
 nifpp::TERM StoreResponse::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(env,
             std::make_tuple(
-                m_key, std::make_tuple(nifpp::str_atom{"ok"}, m_cas)));
+                m_key, std::make_tuple(okAtom(), m_cas)));
     }
 
     return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
@@ -18,6 +18,8 @@ public:
 
     StoreResponse(const void *key, std::size_t keySize, lcb_cas_t cas);
 
+    const std::string &key() const;
+
     nifpp::TERM toTerm(const Env &env) const;
 
 private:
@@ -0,0 +1,315 @@
+/**
+ * @file scheduler.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "scheduler.h"
+
+#include <asio/post.hpp>
+
+#include <algorithm>
+#include <tuple>
+
+namespace cb {
+
+Schedule::Schedule(
+    int timeout, QosClassPtr qosClass, CancelTokenPtr cancelToken)
+    : m_qosClass{std::move(qosClass)}
+    , m_cancelToken{std::move(cancelToken)}
+{
+    if (timeout >= 0) {
+        m_deadline = Clock::now() + std::chrono::milliseconds{timeout};
+    }
+}
+
+const QosClassPtr &Schedule::qosClass() const { return m_qosClass; }
+
+Schedule::Clock::time_point Schedule::deadline() const { return m_deadline; }
+
+bool Schedule::abandoned(Clock::time_point now) const
+{
+    return now >= m_deadline || (m_cancelToken && m_cancelToken->cancelled());
+}
+
+asio::io_service::id Scheduler::id;
+
+constexpr std::chrono::milliseconds Scheduler::kAgingInterval;
+
+constexpr std::chrono::milliseconds Scheduler::kPurgeInterval;
+
+Scheduler::Scheduler(asio::io_service &ioService)
+    : asio::io_service::service{ioService}
+    , m_timer{ioService}
+{
+}
+
+void Scheduler::post(const Schedule &schedule, Keys keys, std::size_t ops,
+    std::size_t bytes, Task task)
+{
+    Submission submission{
+        schedule, std::move(keys), ops, bytes, std::move(task)};
+    if (!m_ring.push(std::move(submission))) {
+        std::lock_guard<std::mutex> guard{m_overflowMutex};
+        m_overflow.emplace_back(std::move(submission));
+        m_overflowed = true;
+    }
+
+    // Only the first post since the last intake wakes the io_service up, the
+    // others are picked up by the same intake.
+    if (!m_signalled.exchange(true)) {
+        asio::post(get_io_context(), [this] { wake(); });
+    }
+}
+
+bool Scheduler::Entry::operator<(const Entry &other) const
+{
+    // The queue keeps the greatest entry on top, so the order is reversed.
+    return std::make_tuple(other.deadline, other.sequence) <
+        std::make_tuple(deadline, sequence);
+}
+
+void Scheduler::shutdown()
+{
+    m_ring.consume([](Submission &&) {});
+    {
+        std::lock_guard<std::mutex> guard{m_overflowMutex};
+        m_overflow.clear();
+    }
+    m_queues.clear();
+    m_lanes.clear();
+    asio::error_code ec;
+    m_timer.cancel(ec);
+}
+
+void Scheduler::wake()
+{
+    if (m_draining && !m_waiting) {
+        // Drain is already posted and will take in the new tasks.
+        return;
+    }
+
+    // The new task may belong to a class that is not throttled.
+    asio::error_code ec;
+    m_timer.cancel(ec);
+    m_draining = true;
+    m_waiting = false;
+    drain();
+}
+
+void Scheduler::intake()
+{
+    // Cleared before taking tasks in, so that a task posted after the ring
+    // has been emptied wakes the io_service up again.
+    m_signalled = false;
+
+    m_ring.consume(
+        [this](Submission &&submission) { enqueue(std::move(submission)); });
+
+    if (m_overflowed.exchange(false)) {
+        std::deque<Submission> overflow;
+        {
+            std::lock_guard<std::mutex> guard{m_overflowMutex};
+            overflow.swap(m_overflow);
+        }
+        for (auto &overflowSubmission : overflow) {
+            enqueue(std::move(overflowSubmission));
+        }
+    }
+}
+
+void Scheduler::enqueue(Submission submission)
+{
+    auto &queue = m_queues[submission.schedule.qosClass().get()];
+    if (queue.entries.empty()) {
+        // A class that was idle does not get credit for the time it did not
+        // use its share.
+        queue.qosClass = submission.schedule.qosClass();
+        queue.finish = std::max(queue.finish, m_virtualTime);
+        queue.waiting = Schedule::Clock::now();
+    }
+
+    // The entry is ordered after the ones queued before it on its keys, even
+    // if its own deadline is earlier.
+    auto deadline = submission.schedule.deadline();
+    for (auto hash : submission.keys) {
+        auto lane = m_lanes.find(hash);
+        if (lane != m_lanes.end()) {
+            deadline = std::max(deadline, lane->second.deadline);
+        }
+    }
+    auto sequence = m_sequence++;
+    for (auto hash : submission.keys) {
+        auto &lane = m_lanes[hash];
+        lane.sequences.push_back(sequence);
+        lane.deadline = deadline;
+    }
+
+    queue.entries.push_back(Entry{std::move(submission.schedule), deadline,
+        sequence, std::move(submission.keys), submission.ops,
+        submission.bytes, std::move(submission.task)});
+    std::push_heap(queue.entries.begin(), queue.entries.end());
+    queue.qosClass->queued();
+}
+
+void Scheduler::drain()
+{
+    Task task;
+    std::vector<Task> dropped;
+    intake();
+    m_waiting = false;
+    auto now = Schedule::Clock::now();
+    auto wakeUp = Schedule::Clock::time_point::max();
+    ClassQueue *next = nullptr;
+    std::int64_t nextPriority = 0;
+    bool pending = false;
+
+    auto purge = now >= m_purgeAt;
+    if (purge) {
+        m_purgeAt = now + kPurgeInterval;
+    }
+
+    // Entries are dropped first, so that the ones held behind them are not
+    // passed over.
+    for (auto &entry : m_queues) {
+        drop(entry.second, now, purge, dropped);
+    }
+
+    for (auto &entry : m_queues) {
+        auto &queue = entry.second;
+        if (queue.entries.empty()) {
+            continue;
+        }
+        pending = true;
+        if (!queue.qosClass->ready(now)) {
+            // A request is counted once however long it is held back, and a
+            // class held back by its own limits is not kept waiting by the
+            // others.
+            auto &front = queue.entries.front();
+            if (!front.throttled) {
+                front.throttled = true;
+                queue.qosClass->throttled();
+            }
+            queue.waiting = now;
+            wakeUp = std::min(wakeUp, queue.qosClass->readyAt(now));
+            continue;
+        }
+        if (blocked(queue.entries.front())) {
+            // The earlier entry of another class is either run by this drain
+            // or waited for with its throttled class.
+            continue;
+        }
+        auto queuePriority = priority(queue, now);
+        if (!next ||
+            std::make_tuple(queuePriority, queue.finish) <
+                std::make_tuple(nextPriority, next->finish)) {
+            next = &queue;
+            nextPriority = queuePriority;
+        }
+    }
+
+    if (next) {
+        std::pop_heap(next->entries.begin(), next->entries.end());
+        auto &entry = next->entries.back();
+        release(entry);
+        task = std::move(entry.task);
+        next->qosClass->scheduled(entry.ops, entry.bytes);
+        auto cost = std::max<std::size_t>(entry.ops, 1);
+        m_virtualTime = std::max(m_virtualTime, next->finish);
+        next->finish += static_cast<double>(cost) / next->qosClass->weight();
+        next->waiting = now;
+        next->entries.pop_back();
+        // Runs one task at a time, so that libcouchbase events handled
+        // by the io_service are interleaved with the queued requests.
+        asio::post(get_io_context(), [this] { drain(); });
+    }
+    else if (pending) {
+        // Cancelled requests of throttled classes are still purged in time.
+        m_waiting = true;
+        m_timer.expires_at(std::min(wakeUp, m_purgeAt));
+        m_timer.async_wait([this](const asio::error_code &ec) {
+            // A timer that fired just before it was cancelled by a new task
+            // must not start a second drain.
+            if (!ec && m_waiting) {
+                drain();
+            }
+        });
+    }
+    else {
+        m_draining = false;
+    }
+
+    for (auto &droppedTask : dropped) {
+        droppedTask(LCB_ETIMEDOUT);
+    }
+
+    if (task) {
+        task(LCB_SUCCESS);
+    }
+}
+
+bool Scheduler::blocked(const Entry &entry) const
+{
+    return std::any_of(
+        entry.keys.begin(), entry.keys.end(), [&](std::size_t hash) {
+            return m_lanes.at(hash).sequences.front() != entry.sequence;
+        });
+}
+
+void Scheduler::release(const Entry &entry)
+{
+    for (auto hash : entry.keys) {
+        auto lane = m_lanes.find(hash);
+        auto &sequences = lane->second.sequences;
+        sequences.erase(
+            std::find(sequences.begin(), sequences.end(), entry.sequence));
+        if (sequences.empty()) {
+            m_lanes.erase(lane);
+        }
+    }
+}
+
+std::int64_t Scheduler::priority(
+    const ClassQueue &queue, Schedule::Clock::time_point now) const
+{
+    return queue.qosClass->priority() - (now - queue.waiting) / kAgingInterval;
+}
+
+void Scheduler::drop(ClassQueue &queue, Schedule::Clock::time_point now,
+    bool purge, std::vector<Task> &dropped)
+{
+    auto &entries = queue.entries;
+    auto abandoned = [now](const Entry &entry) {
+        return entry.schedule.abandoned(now);
+    };
+
+    // Entries are ordered by deadline, so only the cancelled ones and the
+    // ones held behind an earlier entry on the same key can be found below an
+    // entry that is still due. Those still hold their memory and admission
+    // budget, so the whole queue is purged once in a while.
+    auto end = entries.end();
+    if (purge) {
+        end = std::partition(entries.begin(), entries.end(),
+            [&](const Entry &entry) { return !abandoned(entry); });
+    }
+    else {
+        while (end != entries.begin() && abandoned(entries.front())) {
+            std::pop_heap(entries.begin(), end--);
+        }
+    }
+
+    for (auto it = end; it != entries.end(); ++it) {
+        release(*it);
+        dropped.emplace_back(std::move(it->task));
+        queue.qosClass->dropped();
+    }
+    if (end != entries.end()) {
+        entries.erase(end, entries.end());
+        if (purge) {
+            std::make_heap(entries.begin(), entries.end());
+        }
+    }
+}
+
+} // namespace cb
@@ -0,0 +1,171 @@
+/**
+ * @file scheduler.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_SCHEDULER_H
+#define COUCHBASE_SCHEDULER_H
+
+#include "cancelToken.h"
+#include "mpscRing.h"
+#include "qosClass.h"
+#include "smallFunction.h"
+
+#include <asio/io_service.hpp>
+#include <asio/steady_timer.hpp>
+#include <libcouchbase/couchbase.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cb {
+
+/**
+ * QoS class, deadline and cancellation of a request.
+ */
+class Schedule {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Schedule(int timeout, QosClassPtr qosClass,
+        CancelTokenPtr cancelToken = {});
+
+    const QosClassPtr &qosClass() const;
+
+    Clock::time_point deadline() const;
+
+    bool abandoned(Clock::time_point now) const;
+
+private:
+    QosClassPtr m_qosClass;
+    CancelTokenPtr m_cancelToken;
+    Clock::time_point m_deadline = Clock::time_point::max();
+};
+
+/**
+ * Runs tasks posted to an io_service by their QoS class. The classes of the
+ * lowest priority value are served by weighted fair queuing, skipping the
+ * ones that ran out of tokens. A class kept waiting by the others is raised
+ * one priority level for every aging interval it waits, so that classes of a
+ * higher priority value are not starved. Tasks of a class run earliest
+ * deadline first, and in the order they were posted when deadlines are equal.
+ * Tasks past their deadline or cancelled while queued are dropped and called
+ * with LCB_ETIMEDOUT instead of LCB_SUCCESS.
+ *
+ * A task never runs ahead of a task posted before it on any of its keys. Its
+ * deadline is raised to the one of the last task queued on them, and a class
+ * whose next task waits for such a task of another class is passed over
+ * until that task runs.
+ *
+ * Tasks are posted from any thread through a lock-free ring, with a locked
+ * queue taking the overflow when the ring is full. Everything else is only
+ * touched by the thread running the io_service.
+ */
+class Scheduler : public asio::io_service::service {
+public:
+    /**
+     * Task of a request, large enough to keep a key-value request and its
+     * tracked callback in place.
+     */
+    using Task = SmallFunction<void(lcb_error_t), 208>;
+
+    /**
+     * Hashes of the keys a task operates on, telling apart the keys of
+     * different shards.
+     */
+    using Keys = std::vector<std::size_t>;
+
+    static asio::io_service::id id;
+
+    explicit Scheduler(asio::io_service &ioService);
+
+    void post(const Schedule &schedule, Keys keys, std::size_t ops,
+        std::size_t bytes, Task task);
+
+private:
+    struct Submission {
+        Schedule schedule;
+        Keys keys;
+        std::size_t ops;
+        std::size_t bytes;
+        Task task;
+    };
+
+    struct Entry {
+        Schedule schedule;
+        Schedule::Clock::time_point deadline;
+        std::uint64_t sequence;
+        Keys keys;
+        std::size_t ops;
+        std::size_t bytes;
+        Task task;
+        bool throttled = false;
+
+        bool operator<(const Entry &other) const;
+    };
+
+    struct Lane {
+        // Sequences of the queued entries on a key, in the order of posting.
+        std::deque<std::uint64_t> sequences;
+        Schedule::Clock::time_point deadline;
+    };
+
+    struct ClassQueue {
+        QosClassPtr qosClass;
+        double finish = 0;
+        Schedule::Clock::time_point waiting;
+        // Kept as a heap in a vector rather than in a priority queue, so that
+        // cancelled entries below the top can be purged.
+        std::vector<Entry> entries;
+    };
+
+    static constexpr std::size_t kRingSize = 1024;
+    static constexpr std::chrono::milliseconds kAgingInterval{10};
+    static constexpr std::chrono::milliseconds kPurgeInterval{100};
+
+    void shutdown() override;
+
+    void wake();
+
+    void intake();
+
+    void enqueue(Submission submission);
+
+    void drain();
+
+    bool blocked(const Entry &entry) const;
+
+    void release(const Entry &entry);
+
+    std::int64_t priority(
+        const ClassQueue &queue, Schedule::Clock::time_point now) const;
+
+    void drop(ClassQueue &queue, Schedule::Clock::time_point now, bool purge,
+        std::vector<Task> &dropped);
+
+    MpscRing<Submission> m_ring{kRingSize};
+    std::mutex m_overflowMutex;
+    std::deque<Submission> m_overflow;
+    std::atomic<bool> m_overflowed{false};
+    std::atomic<bool> m_signalled{false};
+
+    std::unordered_map<QosClass *, ClassQueue> m_queues;
+    std::unordered_map<std::size_t, Lane> m_lanes;
+    std::uint64_t m_sequence = 0;
+    double m_virtualTime = 0;
+    Schedule::Clock::time_point m_purgeAt;
+    bool m_draining = false;
+    bool m_waiting = false;
+    asio::steady_timer m_timer;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_SCHEDULER_H
@@ -0,0 +1,641 @@
+/**
+ * @file shard.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "shard.h"
+#include "ioOps.h"
+#include "threadBuffer.h"
+
+#include <asio/post.hpp>
+#include <libcouchbase/vbucket.h>
+
+namespace {
+void bootstrapCallback(lcb_t instance, lcb_error_t err)
+{
+    cb::Shard::fromInstance(instance)->bootstrapped(err);
+}
+
+/**
+ * Flat array of libcouchbase commands along with the array of pointers to
+ * them expected by the multi-command API, filled in a single pass. Commands
+ * are copied into packets when scheduled, so both arrays live in buffers
+ * recycled by the worker thread.
+ */
+template <class CommandT> class Commands {
+public:
+    template <class ItemT, typename F>
+    Commands(const std::vector<ItemT> &items, F fill)
+        : m_commands{items.size()}
+        , m_pointers{items.size()}
+    {
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            m_commands[i].version = 0;
+            fill(m_commands[i].v.v0, items[i]);
+            m_pointers[i] = &m_commands[i];
+        }
+    }
+
+    lcb_SIZE size() const { return m_pointers.size(); }
+
+    const CommandT *const *data() const { return m_pointers.data(); }
+
+private:
+    cb::ThreadBuffer<CommandT> m_commands;
+    cb::ThreadBuffer<const CommandT *> m_pointers;
+};
+
+lcb_error_t getMulti(lcb_t instance, const void *cookie,
+    const std::vector<const cb::GetRequest *> &requests)
+{
+    Commands<lcb_get_cmd_t> commands{
+        requests, [](auto &command, const cb::GetRequest *request) {
+            command.key = request->key().c_str();
+            command.nkey = request->key().size();
+            command.exptime = request->expiry();
+            command.lock = request->lock();
+        }};
+
+    return lcb_get(instance, cookie, commands.size(), commands.data());
+}
+
+void getCallback(lcb_t instance, const void *cookie, lcb_error_t err,
+    const lcb_get_resp_t *resp)
+{
+    auto shard = cb::Shard::fromInstance(instance);
+    auto response = err == LCB_SUCCESS
+        ? cb::GetResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas,
+              resp->v.v0.flags, resp->v.v0.bytes, resp->v.v0.nbytes}
+        : cb::GetResponse{err, resp->v.v0.key, resp->v.v0.nkey};
+
+    if (shard->isFlight(cookie)) {
+        shard->completeFlight(cookie, response);
+        return;
+    }
+
+    auto operation =
+        cb::Operation<cb::MultiResponse<cb::GetResponse>>::fromCookie(cookie);
+    operation->response().add(std::move(response));
+    shard->complete(operation);
+}
+
+void storeCallback(lcb_t instance, const void *cookie, lcb_storage_t storage,
+    lcb_error_t err, const lcb_store_resp_t *resp)
+{
+    auto operation =
+        cb::Operation<cb::MultiResponse<cb::StoreResponse>>::fromCookie(cookie);
+    if (err == LCB_SUCCESS) {
+        operation->response().add(
+            cb::StoreResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
+    }
+    else {
+        operation->response().add(
+            cb::StoreResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    }
+    cb::Shard::fromInstance(instance)->complete(operation);
+}
+
+void arithmeticCallback(lcb_t instance, const void *cookie, lcb_error_t err,
+    const lcb_arithmetic_resp_t *resp)
+{
+    auto operation =
+        cb::Operation<cb::MultiResponse<cb::ArithmeticResponse>>::fromCookie(
+            cookie);
+    if (err == LCB_SUCCESS) {
+        operation->response().add(cb::ArithmeticResponse{
+            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas, resp->v.v0.value});
+    }
+    else {
+        operation->response().add(
+            cb::ArithmeticResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    }
+    cb::Shard::fromInstance(instance)->complete(operation);
+}
+
+void removeCallback(lcb_t instance, const void *cookie, lcb_error_t err,
+    const lcb_remove_resp_t *resp)
+{
+    auto operation =
+        cb::Operation<cb::MultiResponse<cb::RemoveResponse>>::fromCookie(
+            cookie);
+    operation->response().add(
+        cb::RemoveResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    cb::Shard::fromInstance(instance)->complete(operation);
+}
+
+void httpCallback(lcb_http_request_t request, lcb_t instance,
+    const void *cookie, lcb_error_t err, const lcb_http_resp_t *resp)
+{
+    auto operation = cb::Operation<cb::HttpResponse>::fromCookie(cookie);
+    operation->response().setError(err);
+    if (err == LCB_SUCCESS) {
+        operation->response().setStatus(resp->v.v0.status);
+        operation->response().setBody(resp->v.v0.bytes, resp->v.v0.nbytes);
+    }
+    cb::Shard::fromInstance(instance)->complete(operation);
+}
+
+void durabilityCallback(lcb_t instance, const void *cookie, lcb_error_t err,
+    const lcb_durability_resp_t *resp)
+{
+    auto operation =
+        cb::Operation<cb::MultiResponse<cb::DurabilityResponse>>::fromCookie(
+            cookie);
+    if (err == LCB_SUCCESS) {
+        operation->response().add(cb::DurabilityResponse{
+            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
+    }
+    else {
+        operation->response().add(
+            cb::DurabilityResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    }
+    cb::Shard::fromInstance(instance)->complete(operation);
+}
+} // namespace
+
+namespace cb {
+
+Shard::Shard(const ConnectRequest &request, const std::string &host,
+    const std::string &configCache, asio::io_service &ioService)
+    : m_ioService{ioService}
+    , m_scheduler{asio::use_service<Scheduler>(ioService)}
+    , m_compressionThreshold{request.compressionThreshold()}
+    , m_getBatch{makeCoalescer<GetRequest, GetResponse>(request)}
+    , m_storeBatch{makeCoalescer<StoreRequest, StoreResponse>(request)}
+    , m_removeBatch{makeCoalescer<RemoveRequest, RemoveResponse>(request)}
+    , m_arithmeticBatch{
+          makeCoalescer<ArithmeticRequest, ArithmeticResponse>(request)}
+{
+    struct lcb_create_st createOpts = {0};
+    createOpts.v.v0.host = host.c_str();
+    createOpts.v.v0.user = request.username().c_str();
+    createOpts.v.v0.passwd = request.password().c_str();
+    createOpts.v.v0.bucket = request.bucket().c_str();
+    createOpts.v.v0.io = createIoOps(ioService);
+
+    lcb_error_t err = lcb_create(&m_instance, &createOpts);
+    if (err != LCB_SUCCESS) {
+        lcb_destroy_io_ops(createOpts.v.v0.io);
+        throw err;
+    }
+
+    lcb_set_cookie(m_instance, this);
+    lcb_set_bootstrap_callback(m_instance, bootstrapCallback);
+    lcb_set_get_callback(m_instance, getCallback);
+    lcb_set_store_callback(m_instance, storeCallback);
+    lcb_set_arithmetic_callback(m_instance, arithmeticCallback);
+    lcb_set_remove_callback(m_instance, removeCallback);
+    lcb_set_http_complete_callback(m_instance, httpCallback);
+    lcb_set_durability_callback(m_instance, durabilityCallback);
+
+    if (!configCache.empty()) {
+        err = lcb_cntl(m_instance, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE,
+            const_cast<char *>(configCache.c_str()));
+        if (err != LCB_SUCCESS) {
+            lcb_destroy(m_instance);
+            throw err;
+        }
+    }
+
+    std::string optName;
+    int optValue;
+    for (const auto &option : request.options()) {
+        std::tie(optName, optValue) = option;
+        if (optName == "operation_timeout") {
+            err = lcb_cntl(
+                m_instance, LCB_CNTL_SET, LCB_CNTL_OP_TIMEOUT, &optValue);
+        }
+        else if (optName == "config_total_timeout") {
+            err = lcb_cntl(m_instance, LCB_CNTL_SET,
+                LCB_CNTL_CONFIGURATION_TIMEOUT, &optValue);
+        }
+        else if (optName == "view_timeout") {
+            err = lcb_cntl(
+                m_instance, LCB_CNTL_SET, LCB_CNTL_VIEW_TIMEOUT, &optValue);
+        }
+        else if (optName == "durability_timeout") {
+            err = lcb_cntl(m_instance, LCB_CNTL_SET,
+                LCB_CNTL_DURABILITY_TIMEOUT, &optValue);
+        }
+        else if (optName == "durability_interval") {
+            err = lcb_cntl(m_instance, LCB_CNTL_SET,
+                LCB_CNTL_DURABILITY_INTERVAL, &optValue);
+        }
+        else if (optName == "http_timeout") {
+            err = lcb_cntl(
+                m_instance, LCB_CNTL_SET, LCB_CNTL_HTTP_TIMEOUT, &optValue);
+        }
+        if (err != LCB_SUCCESS) {
+            lcb_destroy(m_instance);
+            throw err;
+        }
+    }
+}
+
+Shard::~Shard() { lcb_destroy(m_instance); }
+
+ShardPtr Shard::create(const ConnectRequest &request,
+    const std::string &host, const std::string &configCache,
+    asio::io_service &ioService)
+{
+    // The instance's sockets and timers live on the io_service, so it has to
+    // be destroyed there as well.
+    return ShardPtr{new Shard{request, host, configCache, ioService},
+        [](Shard *shard) {
+            asio::post(shard->ioService(), [shard] { delete shard; });
+        }};
+}
+
+Shard *Shard::fromInstance(lcb_t instance)
+{
+    return const_cast<Shard *>(
+        static_cast<const Shard *>(lcb_get_cookie(instance)));
+}
+
+void Shard::bootstrap(Callback<lcb_error_t> callback)
+{
+    lcb_error_t err = lcb_connect(m_instance);
+    if (err != LCB_SUCCESS) {
+        callback(err);
+        return;
+    }
+
+    m_bootstrapCallback = std::move(callback);
+    acquire(1);
+}
+
+void Shard::bootstrapped(lcb_error_t err)
+{
+    if (!m_bootstrapCallback) {
+        return;
+    }
+
+    if (err == LCB_SUCCESS) {
+        lcbvb_CONFIG *config = nullptr;
+        if (lcb_cntl(m_instance, LCB_CNTL_GET, LCB_CNTL_VBCONFIG, &config) ==
+                LCB_SUCCESS &&
+            config) {
+            m_vbuckets = lcbvb_get_nvbuckets(config);
+        }
+    }
+
+    auto callback = std::move(m_bootstrapCallback);
+    m_bootstrapCallback = nullptr;
+    callback(err);
+    release();
+}
+
+asio::io_service &Shard::ioService() { return m_ioService; }
+
+Scheduler &Shard::scheduler() { return m_scheduler; }
+
+std::size_t Shard::vbuckets() const { return m_vbuckets; }
+
+void Shard::get(const MultiRequest<GetRequest> &request,
+    TrackedCallback<MultiResponse<GetResponse>> callback)
+{
+    batch(m_getBatch, request, std::move(callback));
+}
+
+void Shard::schedule(const MultiRequest<GetRequest> &request,
+    TrackedCallback<MultiResponse<GetResponse>> callback)
+{
+    const auto &requests = request.requests();
+    if (requests.empty()) {
+        callback(MultiResponse<GetResponse>{LCB_SUCCESS});
+        return;
+    }
+
+    // Plain gets of a key already in flight wait for its response instead of
+    // fetching it again, unless the key has been written since the fetch was
+    // sent. Touching and locking gets are always sent as is.
+    std::vector<std::pair<const GetRequest *, Flight *>> fetches;
+    std::vector<const GetRequest *> directRequests;
+    auto operation = new Operation<MultiResponse<GetResponse>>{
+        requests.size() + 1, std::move(callback)};
+    operation->response().reserve(requests.size());
+    for (const auto &getRequest : requests) {
+        if (getRequest.expiry() == 0 && !getRequest.lock()) {
+            auto &flight = m_joinable[getRequest.key()];
+            if (!flight) {
+                auto fetch = std::make_unique<Flight>();
+                flight = fetch.get();
+                m_flights.emplace(flight, std::move(fetch));
+                fetches.emplace_back(&getRequest, flight);
+            }
+            flight->waiters.emplace_back(operation);
+        }
+        else {
+            directRequests.emplace_back(&getRequest);
+        }
+    }
+    acquire(requests.size() + 1);
+
+    if (!fetches.empty()) {
+        lcb_error_t err = LCB_SUCCESS;
+        lcb_sched_enter(m_instance);
+        for (const auto &fetch : fetches) {
+            lcb_CMDGET command = {};
+            LCB_CMD_SET_KEY(&command, fetch.first->key().c_str(),
+                fetch.first->key().size());
+            err = lcb_get3(m_instance, fetch.second, &command);
+            if (err != LCB_SUCCESS) {
+                break;
+            }
+        }
+
+        if (err != LCB_SUCCESS) {
+            lcb_sched_fail(m_instance);
+            for (const auto &fetch : fetches) {
+                completeFlight(fetch.second,
+                    GetResponse{err, fetch.first->key().c_str(),
+                        fetch.first->key().size()});
+            }
+        }
+        else {
+            lcb_sched_leave(m_instance);
+        }
+    }
+
+    if (!directRequests.empty()) {
+        lcb_error_t err = getMulti(m_instance, operation, directRequests);
+        if (err != LCB_SUCCESS) {
+            for (const auto getRequest : directRequests) {
+                operation->response().add(GetResponse{err,
+                    getRequest->key().c_str(), getRequest->key().size()});
+                complete(operation);
+            }
+        }
+    }
+
+    complete(operation);
+}
+
+bool Shard::isFlight(const void *cookie) const
+{
+    return m_flights.count(cookie) > 0;
+}
+
+void Shard::completeFlight(const void *cookie, const GetResponse &response)
+{
+    auto it = m_flights.find(cookie);
+    if (it == m_flights.end()) {
+        return;
+    }
+
+    auto flight = std::move(it->second);
+    m_flights.erase(it);
+    auto joinable = m_joinable.find(response.key());
+    if (joinable != m_joinable.end() && joinable->second == flight.get()) {
+        m_joinable.erase(joinable);
+    }
+    for (auto operation : flight->waiters) {
+        operation->response().add(response);
+        complete(operation);
+    }
+}
+
+template <class RequestT>
+void Shard::retire(const MultiRequest<RequestT> &request)
+{
+    // A fetch sent before a write may return the value it replaces, so gets
+    // scheduled after the write start a fetch of their own. The fetch still
+    // answers the gets that joined it.
+    if (m_joinable.empty()) {
+        return;
+    }
+    for (const auto &keyRequest : request.requests()) {
+        m_joinable.erase(keyRequest.key());
+    }
+}
+
+void Shard::store(const MultiRequest<StoreRequest> &request,
+    TrackedCallback<MultiResponse<StoreResponse>> callback)
+{
+    batch(m_storeBatch, request, std::move(callback));
+}
+
+void Shard::schedule(const MultiRequest<StoreRequest> &request,
+    TrackedCallback<MultiResponse<StoreResponse>> callback)
+{
+    retire(request);
+    const auto &requests = request.requests();
+    auto operation = new Operation<MultiResponse<StoreResponse>>{
+        requests.size(), std::move(callback)};
+    operation->response().reserve(requests.size());
+
+    // Values are copied into packets straight from the Erlang binaries they
+    // refer to, which requires the scatter-gather command interface.
+    // Compressed values are copied from a buffer reused for every value.
+    lcb_error_t err = LCB_SUCCESS;
+    compression::Buffer compressed{0};
+    lcb_sched_enter(m_instance);
+    for (const auto &storeRequest : requests) {
+        const auto &value = storeRequest.value();
+        lcb_CMDSTORE command = {};
+        LCB_CMD_SET_KEY(
+            &command, storeRequest.key().c_str(), storeRequest.key().size());
+        LCB_CMD_SET_VALUEIOV(&command,
+            const_cast<lcb_IOV *>(value.segments().data()),
+            value.segments().size());
+        command.flags = storeRequest.flags();
+        // Dictionaries are meant for values too small to compress on their
+        // own, so the threshold applies only to values compressed without
+        // one. Values whose dictionary has not been loaded are stored as
+        // they are. Appended and prepended values join the stored value in
+        // place and leave its flags as they are, so they are never
+        // compressed.
+        const auto &method = value.compression();
+        auto joins = storeRequest.operation() == LCB_APPEND ||
+            storeRequest.operation() == LCB_PREPEND;
+        if (!joins && method.codec != compression::Codec::none &&
+            (method.dictionary != 0 ||
+                value.size() >= m_compressionThreshold) &&
+            compression::compress(method, value.segments().data(),
+                value.segments().size(), compressed) &&
+            compressed.size() < value.size()) {
+            LCB_CMD_SET_VALUE(&command, compressed.data(), compressed.size());
+            command.flags =
+                compression::withMethod(storeRequest.flags(), method);
+        }
+        command.operation = storeRequest.operation();
+        command.cas = storeRequest.cas();
+        command.exptime = storeRequest.expiry();
+        err = lcb_store3(m_instance, operation, &command);
+        if (err != LCB_SUCCESS) {
+            break;
+        }
+    }
+
+    if (err != LCB_SUCCESS) {
+        lcb_sched_fail(m_instance);
+    }
+    else {
+        lcb_sched_leave(m_instance);
+    }
+    submit(operation, err);
+}
+
+void Shard::remove(const MultiRequest<RemoveRequest> &request,
+    TrackedCallback<MultiResponse<RemoveResponse>> callback)
+{
+    batch(m_removeBatch, request, std::move(callback));
+}
+
+void Shard::schedule(const MultiRequest<RemoveRequest> &request,
+    TrackedCallback<MultiResponse<RemoveResponse>> callback)
+{
+    retire(request);
+    const auto &requests = request.requests();
+    Commands<lcb_remove_cmd_t> commands{
+        requests, [](auto &command, const RemoveRequest &removeRequest) {
+            command.key = removeRequest.key().c_str();
+            command.nkey = removeRequest.key().size();
+            command.cas = removeRequest.cas();
+        }};
+
+    auto operation = new Operation<MultiResponse<RemoveResponse>>{
+        requests.size(), std::move(callback)};
+    operation->response().reserve(requests.size());
+    submit(operation, lcb_remove(m_instance, operation, commands.size(),
+                          commands.data()));
+}
+
+void Shard::arithmetic(const MultiRequest<ArithmeticRequest> &request,
+    TrackedCallback<MultiResponse<ArithmeticResponse>> callback)
+{
+    batch(m_arithmeticBatch, request, std::move(callback));
+}
+
+void Shard::schedule(const MultiRequest<ArithmeticRequest> &request,
+    TrackedCallback<MultiResponse<ArithmeticResponse>> callback)
+{
+    retire(request);
+    const auto &requests = request.requests();
+    Commands<lcb_arithmetic_cmd_t> commands{requests,
+        [](auto &command, const ArithmeticRequest &arithmeticRequest) {
+            command.key = arithmeticRequest.key().c_str();
+            command.nkey = arithmeticRequest.key().size();
+            command.delta = arithmeticRequest.delta();
+            command.create = arithmeticRequest.create();
+            command.initial = arithmeticRequest.initial();
+            command.exptime = arithmeticRequest.expiry();
+        }};
+
+    auto operation = new Operation<MultiResponse<ArithmeticResponse>>{
+        requests.size(), std::move(callback)};
+    operation->response().reserve(requests.size());
+    submit(operation, lcb_arithmetic(m_instance, operation, commands.size(),
+                          commands.data()));
+}
+
+void Shard::http(
+    const HttpRequest &request, TrackedCallback<HttpResponse> callback)
+{
+    lcb_http_request_t req;
+    lcb_http_cmd_t command;
+    command.version = 0;
+    command.v.v0.method = request.method();
+    command.v.v0.path = request.path().c_str();
+    command.v.v0.npath = request.path().size();
+    command.v.v0.content_type = request.contentType().c_str();
+    command.v.v0.body = request.body().c_str();
+    command.v.v0.nbody = request.body().size();
+    command.v.v0.chunked = false;
+
+    auto operation = new Operation<HttpResponse>{1, std::move(callback)};
+    submit(operation, lcb_make_http_request(m_instance, operation,
+                          request.type(), &command, &req));
+}
+
+void Shard::durability(const MultiRequest<DurabilityRequest> &request,
+    const DurabilityRequestOptions &requestOptions,
+    TrackedCallback<MultiResponse<DurabilityResponse>> callback)
+{
+    const auto &requests = request.requests();
+    Commands<lcb_durability_cmd_t> commands{requests,
+        [](auto &command, const DurabilityRequest &durabilityRequest) {
+            command.key = durabilityRequest.key().c_str();
+            command.nkey = durabilityRequest.key().size();
+            command.cas = durabilityRequest.cas();
+        }};
+
+    lcb_durability_opts_t options = {};
+    options.v.v0.persist_to = requestOptions.persistTo();
+    options.v.v0.replicate_to = requestOptions.replicateTo();
+    options.v.v0.cap_max = 1;
+
+    auto operation = new Operation<MultiResponse<DurabilityResponse>>{
+        requests.size(), std::move(callback)};
+    operation->response().reserve(requests.size());
+    submit(operation, lcb_durability_poll(m_instance, operation, &options,
+                          commands.size(), commands.data()));
+}
+
+template <class RequestT, class ResponseT>
+std::unique_ptr<Coalescer<RequestT, ResponseT>> Shard::makeCoalescer(
+    const ConnectRequest &request)
+{
+    if (request.batchWindow().count() == 0 || request.batchSize() < 2) {
+        return {};
+    }
+
+    return std::make_unique<Coalescer<RequestT, ResponseT>>(m_ioService,
+        request.batchWindow(), request.batchSize(),
+        [this](const MultiRequest<RequestT> &batchRequest,
+            TrackedCallback<MultiResponse<ResponseT>> callback) {
+            schedule(batchRequest, std::move(callback));
+            release(batchRequest.requests().size());
+        });
+}
+
+template <class RequestT, class ResponseT>
+void Shard::batch(std::unique_ptr<Coalescer<RequestT, ResponseT>> &coalescer,
+    const MultiRequest<RequestT> &request,
+    TrackedCallback<MultiResponse<ResponseT>> callback)
+{
+    if (!coalescer || request.requests().size() != 1) {
+        schedule(request, std::move(callback));
+        return;
+    }
+
+    // Queued requests keep the shard alive until their batch is scheduled.
+    acquire(1);
+    coalescer->add(request.requests().front(), std::move(callback));
+}
+
+template <class ResponseT>
+void Shard::submit(Operation<ResponseT> *operation, lcb_error_t err)
+{
+    if (err != LCB_SUCCESS) {
+        operation->fail(err);
+        delete operation;
+    }
+    else if (operation->pending() == 0) {
+        operation->finish();
+        delete operation;
+    }
+    else {
+        acquire(operation->pending());
+    }
+}
+
+void Shard::acquire(std::size_t pending)
+{
+    if (m_pending == 0) {
+        m_self = shared_from_this();
+    }
+    m_pending += pending;
+}
+
+void Shard::release(std::size_t pending)
+{
+    m_pending -= pending;
+    if (m_pending == 0) {
+        m_self.reset();
+    }
+}
+
+} // namespace cb
@@ -0,0 +1,147 @@
+/**
+ * @file shard.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_SHARD_H
+#define COUCHBASE_SHARD_H
+
+#include "coalescer.h"
+#include "operation.h"
+#include "requests/requests.h"
+#include "responses/responses.h"
+#include "scheduler.h"
+#include "types.h"
+
+#include <asio/io_service.hpp>
+#include <libcouchbase/couchbase.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cb {
+
+/**
+ * Single libcouchbase instance driven by the io_service of a worker thread.
+ * Shards are destroyed on their io_service and are kept alive while they
+ * have requests in flight.
+ */
+class Shard : public std::enable_shared_from_this<Shard> {
+public:
+    Shard(const ConnectRequest &request, const std::string &host,
+        const std::string &configCache, asio::io_service &ioService);
+
+    ~Shard();
+
+    static ShardPtr create(const ConnectRequest &request,
+        const std::string &host, const std::string &configCache,
+        asio::io_service &ioService);
+
+    static Shard *fromInstance(lcb_t instance);
+
+    void bootstrap(Callback<lcb_error_t> callback);
+
+    void bootstrapped(lcb_error_t err);
+
+    asio::io_service &ioService();
+
+    Scheduler &scheduler();
+
+    std::size_t vbuckets() const;
+
+    void get(const MultiRequest<GetRequest> &request,
+        TrackedCallback<MultiResponse<GetResponse>> callback);
+
+    void store(const MultiRequest<StoreRequest> &request,
+        TrackedCallback<MultiResponse<StoreResponse>> callback);
+
+    void remove(const MultiRequest<RemoveRequest> &request,
+        TrackedCallback<MultiResponse<RemoveResponse>> callback);
+
+    void arithmetic(const MultiRequest<ArithmeticRequest> &request,
+        TrackedCallback<MultiResponse<ArithmeticResponse>> callback);
+
+    void http(
+        const HttpRequest &request, TrackedCallback<HttpResponse> callback);
+
+    void durability(const MultiRequest<DurabilityRequest> &request,
+        const DurabilityRequestOptions &options,
+        TrackedCallback<MultiResponse<DurabilityResponse>> callback);
+
+    bool isFlight(const void *cookie) const;
+
+    void completeFlight(const void *cookie, const GetResponse &response);
+
+    template <class ResponseT> void complete(Operation<ResponseT> *operation)
+    {
+        if (operation->complete()) {
+            operation->finish();
+            delete operation;
+        }
+        release();
+    }
+
+private:
+    /**
+     * Fetch of a key shared by the plain gets scheduled while it is joinable.
+     * It is the cookie of its libcouchbase command.
+     */
+    struct Flight {
+        std::vector<Operation<MultiResponse<GetResponse>> *> waiters;
+    };
+
+    template <class RequestT>
+    void retire(const MultiRequest<RequestT> &request);
+
+    void schedule(const MultiRequest<GetRequest> &request,
+        TrackedCallback<MultiResponse<GetResponse>> callback);
+
+    void schedule(const MultiRequest<StoreRequest> &request,
+        TrackedCallback<MultiResponse<StoreResponse>> callback);
+
+    void schedule(const MultiRequest<RemoveRequest> &request,
+        TrackedCallback<MultiResponse<RemoveResponse>> callback);
+
+    void schedule(const MultiRequest<ArithmeticRequest> &request,
+        TrackedCallback<MultiResponse<ArithmeticResponse>> callback);
+
+    template <class RequestT, class ResponseT>
+    std::unique_ptr<Coalescer<RequestT, ResponseT>> makeCoalescer(
+        const ConnectRequest &request);
+
+    template <class RequestT, class ResponseT>
+    void batch(std::unique_ptr<Coalescer<RequestT, ResponseT>> &coalescer,
+        const MultiRequest<RequestT> &request,
+        TrackedCallback<MultiResponse<ResponseT>> callback);
+
+    template <class ResponseT>
+    void submit(Operation<ResponseT> *operation, lcb_error_t err);
+
+    void acquire(std::size_t pending);
+
+    void release(std::size_t pending = 1);
+
+    asio::io_service &m_ioService;
+    Scheduler &m_scheduler;
+    lcb_t m_instance;
+    std::size_t m_vbuckets = 0;
+    std::size_t m_pending = 0;
+    std::size_t m_compressionThreshold;
+    ShardPtr m_self;
+    Callback<lcb_error_t> m_bootstrapCallback;
+    std::unordered_map<const void *, std::unique_ptr<Flight>> m_flights;
+    std::unordered_map<std::string, Flight *> m_joinable;
+    std::unique_ptr<Coalescer<GetRequest, GetResponse>> m_getBatch;
+    std::unique_ptr<Coalescer<StoreRequest, StoreResponse>> m_storeBatch;
+    std::unique_ptr<Coalescer<RemoveRequest, RemoveResponse>> m_removeBatch;
+    std::unique_ptr<Coalescer<ArithmeticRequest, ArithmeticResponse>>
+        m_arithmeticBatch;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_SHARD_H
@@ -0,0 +1,167 @@
+/**
+ * @file smallFunction.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_SMALL_FUNCTION_H
+#define COUCHBASE_SMALL_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cb {
+
+template <typename Signature, std::size_t Capacity = 192> class SmallFunction;
+
+/**
+ * Move-only function wrapper keeping callables of up to Capacity bytes in
+ * place. Larger ones, and ones that may throw when moved, are kept on the
+ * heap as std::function would.
+ */
+template <typename R, typename... Args, std::size_t Capacity>
+class SmallFunction<R(Args...), Capacity> {
+public:
+    SmallFunction() = default;
+
+    SmallFunction(std::nullptr_t) {}
+
+    template <typename F,
+        typename = std::enable_if_t<
+            !std::is_same<std::decay_t<F>, SmallFunction>::value>>
+    SmallFunction(F &&f)
+    {
+        using Callable = std::decay_t<F>;
+        using Holder = std::conditional_t<fits<Callable>(), Inline<Callable>,
+            Heap<Callable>>;
+        Holder::create(&m_storage, std::forward<F>(f));
+        m_ops = &Holder::ops;
+    }
+
+    SmallFunction(SmallFunction &&other) noexcept { moveFrom(other); }
+
+    SmallFunction(const SmallFunction &) = delete;
+
+    SmallFunction &operator=(SmallFunction &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallFunction &operator=(const SmallFunction &) = delete;
+
+    ~SmallFunction() { reset(); }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    /**
+     * Tells whether a callable of the type is kept in place.
+     */
+    template <typename F> static constexpr bool fits()
+    {
+        return sizeof(F) <= Capacity &&
+            alignof(F) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<F>::value;
+    }
+
+    R operator()(Args... args)
+    {
+        return m_ops->invoke(&m_storage, std::forward<Args>(args)...);
+    }
+
+private:
+    using Storage =
+        std::aligned_storage_t<Capacity, alignof(std::max_align_t)>;
+
+    struct Ops {
+        R (*invoke)(void *, Args &&...);
+        void (*move)(void *, void *);
+        void (*destroy)(void *);
+    };
+
+    template <typename F> struct Inline {
+        template <typename G> static void create(void *storage, G &&f)
+        {
+            new (storage) F(std::forward<G>(f));
+        }
+
+        static R invoke(void *storage, Args &&... args)
+        {
+            return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void move(void *from, void *to)
+        {
+            new (to) F(std::move(*static_cast<F *>(from)));
+            static_cast<F *>(from)->~F();
+        }
+
+        static void destroy(void *storage) { static_cast<F *>(storage)->~F(); }
+
+        static constexpr Ops ops{invoke, move, destroy};
+    };
+
+    template <typename F> struct Heap {
+        template <typename G> static void create(void *storage, G &&f)
+        {
+            *static_cast<F **>(storage) = new F(std::forward<G>(f));
+        }
+
+        static R invoke(void *storage, Args &&... args)
+        {
+            return (**static_cast<F **>(storage))(std::forward<Args>(args)...);
+        }
+
+        static void move(void *from, void *to)
+        {
+            *static_cast<F **>(to) = *static_cast<F **>(from);
+        }
+
+        static void destroy(void *storage)
+        {
+            delete *static_cast<F **>(storage);
+        }
+
+        static constexpr Ops ops{invoke, move, destroy};
+    };
+
+    void moveFrom(SmallFunction &other)
+    {
+        if (other.m_ops) {
+            other.m_ops->move(&other.m_storage, &m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    Storage m_storage;
+    const Ops *m_ops = nullptr;
+};
+
+template <typename R, typename... Args, std::size_t Capacity>
+template <typename F>
+constexpr typename SmallFunction<R(Args...), Capacity>::Ops
+    SmallFunction<R(Args...), Capacity>::Inline<F>::ops;
+
+template <typename R, typename... Args, std::size_t Capacity>
+template <typename F>
+constexpr typename SmallFunction<R(Args...), Capacity>::Ops
+    SmallFunction<R(Args...), Capacity>::Heap<F>::ops;
+
+} // namespace cb
+
+#endif // COUCHBASE_SMALL_FUNCTION_H
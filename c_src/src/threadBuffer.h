@@ -0,0 +1,74 @@
+/**
+ * @file threadBuffer.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_THREAD_BUFFER_H
+#define COUCHBASE_THREAD_BUFFER_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace cb {
+
+/**
+ * Vector of value-initialized elements borrowed from a free list of the
+ * calling thread and given back to it on destruction, so that buffers
+ * needed for every batch reuse memory instead of allocating it. Buffers
+ * grown past a limit are released instead, which bounds the memory held by
+ * idle threads.
+ */
+template <typename T> class ThreadBuffer {
+public:
+    explicit ThreadBuffer(std::size_t size)
+    {
+        auto &buffers = freeList();
+        if (!buffers.empty()) {
+            m_items = std::move(buffers.back());
+            buffers.pop_back();
+        }
+        m_items.resize(size);
+    }
+
+    ThreadBuffer(const ThreadBuffer &) = delete;
+
+    ThreadBuffer &operator=(const ThreadBuffer &) = delete;
+
+    ~ThreadBuffer()
+    {
+        auto &buffers = freeList();
+        if (m_items.capacity() <= kMaxCapacity && buffers.size() < kMaxFree) {
+            m_items.clear();
+            buffers.emplace_back(std::move(m_items));
+        }
+    }
+
+    T &operator[](std::size_t i) { return m_items[i]; }
+
+    T *data() { return m_items.data(); }
+
+    const T *data() const { return m_items.data(); }
+
+    std::size_t size() const { return m_items.size(); }
+
+    void resize(std::size_t size) { m_items.resize(size); }
+
+private:
+    static constexpr std::size_t kMaxCapacity = 65536;
+    static constexpr std::size_t kMaxFree = 4;
+
+    static std::vector<std::vector<T>> &freeList()
+    {
+        thread_local std::vector<std::vector<T>> buffers;
+        return buffers;
+    }
+
+    std::vector<T> m_items;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_THREAD_BUFFER_H
@@ -8,15 +8,32 @@
 #ifndef CBERL_TYPES_H
 #define CBERL_TYPES_H
 
+#include "smallFunction.h"
+
 #include <memory>
 
 namespace cb {
 
 class Client;
 class Connection;
+class Shard;
 
 using ClientPtr = std::shared_ptr<Client>;
 using ConnectionPtr = std::shared_ptr<Connection>;
+using ShardPtr = std::shared_ptr<Shard>;
+
+/**
+ * Callback of a request, large enough to keep the reply context of a NIF in
+ * place.
+ */
+template <typename T> using Callback = SmallFunction<void(const T &), 80>;
+
+/**
+ * Callback of a request admitted by a connection, which wraps the request
+ * callback to account for the request in flight when it completes.
+ */
+template <typename T>
+using TrackedCallback = SmallFunction<void(const T &), 128>;
 
 } // namespace cb
 
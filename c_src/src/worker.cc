@@ -0,0 +1,43 @@
+/**
+ * @file worker.cc
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "worker.h"
+
+namespace {
+thread_local asio::io_service *currentIoService = nullptr;
+} // namespace
+
+namespace cb {
+
+Worker::Worker()
+    : m_ioService{std::make_shared<asio::io_service>(1)}
+    , m_work{asio::make_work_guard(*m_ioService)}
+    , m_thread{[ioService = m_ioService] {
+        currentIoService = ioService.get();
+        ioService->run();
+    }}
+{
+}
+
+Worker::~Worker()
+{
+    // Lets the shards still in use finish their requests and get destroyed
+    // on the io_service before the thread exits.
+    m_work.reset();
+    if (m_thread.get_id() == std::this_thread::get_id()) {
+        m_thread.detach();
+    }
+    else {
+        m_thread.join();
+    }
+}
+
+asio::io_service &Worker::ioService() { return *m_ioService; }
+
+asio::io_service *Worker::current() { return currentIoService; }
+
+} // namespace cb
@@ -0,0 +1,45 @@
+/**
+ * @file worker.h
+ * @author Krzysztof Trzepla
+ * @copyright (C) 2017: Krzysztof Trzepla
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef COUCHBASE_WORKER_H
+#define COUCHBASE_WORKER_H
+
+#include <asio/executor_work_guard.hpp>
+#include <asio/io_service.hpp>
+
+#include <memory>
+#include <thread>
+
+namespace cb {
+
+/**
+ * Thread running an io_service that drives libcouchbase instances of many
+ * shards. On destruction it waits for the io_service to run out of work.
+ */
+class Worker {
+public:
+    Worker();
+
+    ~Worker();
+
+    asio::io_service &ioService();
+
+    /**
+     * Returns the io_service run by the calling thread, or nullptr if it is
+     * not a worker thread.
+     */
+    static asio::io_service *current();
+
+private:
+    std::shared_ptr<asio::io_service> m_ioService;
+    asio::executor_work_guard<asio::io_service::executor_type> m_work;
+    std::thread m_thread;
+};
+
+} // namespace cb
+
+#endif // COUCHBASE_WORKER_H
@@ -14,9 +14,12 @@
 -behaviour(gen_server).
 
 %% API
--export([connect/6, get/5, bulk_get/3, store/8, bulk_store/3, remove/4,
-    bulk_remove/3, arithmetic/6, bulk_arithmetic/3, http/7, durability/6,
-    bulk_durability/4]).
+-export([connect/6, start_pool/7, stop_pool/1, get/5, bulk_get/3,
+    get_paths/4, bulk_get_paths/4, store/8,
+    bulk_store/3, remove/4, bulk_remove/3, arithmetic/6, bulk_arithmetic/3,
+    http/7, durability/6, bulk_durability/4, train_dictionary/5,
+    load_dictionary/3, unload_dictionary/1, stats/1, inflight/1, set_class/1,
+    configure_class/3]).
 
 %% gen_server callbacks
 -export([init/1, handle_call/3, handle_cast/2, handle_info/2, terminate/2,
@@ -32,10 +35,30 @@
                        {view_timeout, pos_integer()} | % in microseconds
                        {durability_interval, pos_integer()} | % in microseconds
                        {durability_timeout, pos_integer()} | % in microseconds
-                       {http_timeout, pos_integer()}. % in microseconds
+                       {http_timeout, pos_integer()} | % in microseconds
+                       {shards, pos_integer()} |
+                       {workers, pos_integer()} |
+                       {batch_window, pos_integer()} | % in microseconds
+                       {batch_size, pos_integer()} |
+                       {max_inflight_ops, pos_integer()} |
+                       {max_inflight_bytes, pos_integer()} |
+                       {config_cache, file:filename_all()} |
+                       {safe_decode, boolean()} |
+                       {compression_threshold, non_neg_integer()} |
+                       {lazy, boolean()} |
+                       {publish, boolean()}.
 -type key() :: binary().
--type value() :: binary() | jiffy:json_value() | term().
--type encoder() :: none | json | raw.
+-type json_value() :: null | true | false | atom() | number() | binary() |
+                      [json_value()] | {[{binary() | atom(), json_value()}]} |
+                      #{binary() | atom() => json_value()}.
+-type json_path() :: [binary() | non_neg_integer()].
+-type value() :: iodata() | json_value() | term().
+-type codec() :: lz4 | zstd.
+-type dictionary_id() :: 1..65535.
+-type dictionary() :: binary().
+-type compression() :: codec() | {zstd, dictionary_id()}.
+-type encoder() :: none | json | raw |
+                   {compressed, compression(), none | json | raw}.
 -type cas() :: non_neg_integer().
 -type expiry() :: non_neg_integer().
 -type store_operation() :: add | replace | set | append | prepend.
@@ -47,20 +70,30 @@
 -type http_content_type() :: binary().
 -type http_status() :: integer().
 -type http_body() :: binary().
+-type class() :: interactive | batch | atom().
+-type class_opt() :: {priority, non_neg_integer()} |
+                     {weight, pos_integer()} |
+                     {ops_per_sec, non_neg_integer()} |
+                     {bytes_per_sec, non_neg_integer()}.
 -type persist_to() :: -1 | non_neg_integer().
 -type replicate_to() :: -1 | non_neg_integer().
 
 -export_type([connection/0, host/0, username/0, password/0, bucket/0,
     connect_opt/0]).
--export_type([key/0, value/0, encoder/0, cas/0, expiry/0]).
+-export_type([key/0, json_value/0, json_path/0, value/0, codec/0,
+    dictionary_id/0, dictionary/0, compression/0, encoder/0, cas/0,
+    expiry/0]).
 -export_type([store_operation/0]).
 -export_type([arithmetic_delta/0, arithmetic_default/0]).
 -export_type([http_type/0, http_method/0, http_path/0, http_content_type/0,
     http_status/0, http_body/0]).
--export_type([persist_to/0, replicate_to/0]).
+-export_type([class/0, class_opt/0, persist_to/0, replicate_to/0]).
 
 -type get_request() :: {key(), expiry(), boolean()}.
 -type get_response() :: {key(), {ok, cas(), value()} | {error, term()}}.
+-type get_paths_response() :: {key(),
+                               {ok, cas(), [json_value() | undefined]} |
+                               {error, term()}}.
 -type store_request() :: {store_operation(), key(), value(), encoder(), cas(),
                           expiry()}.
 -type store_response() :: {key(), {ok, cas()} | {error, term()}}.
@@ -74,15 +107,29 @@
 -type durability_request() :: {key(), cas()}.
 -type durability_response() :: {key(), {ok, cas()} | {error, term()}}.
 -type durability_options() :: {persist_to(), replicate_to()}.
+-type resources() :: {cberl_nif:client(), cberl_nif:connection()}.
 
--export_type([get_request/0, get_response/0, store_request/0, store_response/0,
+-export_type([get_request/0, get_response/0, get_paths_response/0,
+    store_request/0, store_response/0,
     remove_request/0, remove_response/0, arithmetic_request/0,
     arithmetic_response/0, durability_request/0, durability_response/0,
     durability_options/0]).
 
+-define(RESOURCES_KEY(Connection), {?MODULE, Connection}).
+-define(CLASS_KEY, cberl_class).
+-define(APP, cberl).
+-define(MAX_TIMEOUT, 16#7fffffff).
+-define(DICTIONARY_CAPACITY, 32768).
+-define(DICTIONARY_KEY(Id),
+    <<"cberl_dictionary:", (integer_to_binary(Id))/binary>>).
+
 -record(state, {
     client :: cberl_nif:client(),
-    connection :: cberl_nif:connection()
+    connection :: undefined | cberl_nif:connection(),
+    connect_ref :: undefined | cberl_nif:request_id(),
+    connect_timer :: undefined | reference(),
+    publish = true :: boolean(),
+    waiters = [] :: [{pid(), Tag :: term()}]
 }).
 
 -type state() :: #state{}.
@@ -103,6 +150,30 @@ connect(Host, Username, Password, Bucket, Opts, Timeout) ->
         Host, Username, Password, Bucket, Opts, Timeout
     ], []).
 
+%%--------------------------------------------------------------------
+%% @doc
+%% Starts a pool of connections to a CouchBase database. The pool can be
+%% used in place of a connection, in which case each request is routed to
+%% the less busy of two pool connections: the one tied to the scheduler of
+%% the calling process and a random one.
+%% @end
+%%--------------------------------------------------------------------
+-spec start_pool(Size :: pos_integer(), host(), username(), password(),
+    bucket(), [connect_opt()], timeout()) ->
+    {ok, connection()} | {error, Reason :: term()}.
+start_pool(Size, Host, Username, Password, Bucket, Opts, Timeout) ->
+    cberl_pool:start_link(Size, Host, Username, Password, Bucket, Opts,
+        Timeout).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Stops a pool of connections.
+%% @end
+%%--------------------------------------------------------------------
+-spec stop_pool(connection()) -> ok.
+stop_pool(Pool) ->
+    cberl_pool:stop(Pool).
+
 %%--------------------------------------------------------------------
 %% @doc
 %% Returns value from a CouchBase database.
@@ -120,28 +191,84 @@ get(Connection, Key, Expiry, Lock, Timeout) ->
 
 %%--------------------------------------------------------------------
 %% @doc
-%% Returns values from a CouchBase database using bulk request.
+%% Returns values from a CouchBase database using bulk request. Values of
+%% the 'json' and 'raw' encoders are decoded by the NIF, so the caller
+%% receives terms only.
 %% @end
 %%--------------------------------------------------------------------
 -spec bulk_get(connection(), [get_request()], timeout()) ->
     {ok, [get_response()]} | {error, Reason :: term()}.
 bulk_get(Connection, Requests, Timeout) ->
-    case call(Connection, {get, [Requests]}, Timeout) of
-        {ok, Responses} ->
-            Responses2 = lists:map(fun
-                ({Key, {ok, Cas, Flags, Value}}) ->
-                    {Key, {ok, Cas, decode(Flags, Value)}};
-                ({Key, {error, Reason}}) ->
-                    {Key, {error, Reason}}
-            end, Responses),
-            {ok, Responses2};
-        {error, Reason} ->
-            {error, Reason}
+    with_dictionaries(Connection, Requests, fun(Requests2, Timeout2) ->
+        case call(Connection, {get, [Requests2]}, Timeout2) of
+            {ok, Responses} ->
+                Responses2 = lists:map(fun
+                    ({Key, {ok, Cas, _Flags, Value}}) ->
+                        {Key, {ok, Cas, Value}};
+                    ({Key, {error, Reason}}) ->
+                        {Key, {error, Reason}}
+                end, Responses),
+                {ok, Responses2};
+            {error, Reason} ->
+                {error, Reason}
+        end
+    end, Timeout).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns values at the paths of a JSON document from a CouchBase database.
+%% A path lists the keys of objects and the zero-based indices of arrays
+%% leading to a value, e.g. [<<"tags">>, 0]. Only the values at the paths are
+%% decoded, in the order of the paths, and values of paths the document does
+%% not contain are 'undefined'. Values not stored as JSON yield
+%% {error, not_json}.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_paths(connection(), key(), [json_path()], timeout()) ->
+    {ok, cas(), [json_value() | undefined]} | {error, Reason :: term()}.
+get_paths(Connection, Key, Paths, Timeout) ->
+    case bulk_get_paths(Connection, [{Key, 0, false}], Paths, Timeout) of
+        {ok, [{Key, {ok, Cas, Values}}]} -> {ok, Cas, Values};
+        {ok, [{Key, {error, Reason}}]} -> {error, Reason};
+        {error, Reason} -> {error, Reason}
     end.
 
 %%--------------------------------------------------------------------
 %% @doc
-%% Stores key-value pair in a CouchBase database.
+%% Returns values at the same paths of JSON documents from a CouchBase
+%% database using bulk request.
+%% @end
+%%--------------------------------------------------------------------
+-spec bulk_get_paths(connection(), [get_request()], [json_path()],
+    timeout()) -> {ok, [get_paths_response()]} | {error, Reason :: term()}.
+bulk_get_paths(Connection, Requests, Paths, Timeout) ->
+    with_dictionaries(Connection, Requests, fun(Requests2, Timeout2) ->
+        case call(Connection, {get_paths, [Requests2, Paths]}, Timeout2) of
+            {ok, Responses} ->
+                Responses2 = lists:map(fun
+                    ({Key, {ok, Cas, 1, Values}}) ->
+                        {Key, {ok, Cas, Values}};
+                    ({Key, {ok, _Cas, _Flags, _Value}}) ->
+                        {Key, {error, not_json}};
+                    ({Key, {error, Reason}}) ->
+                        {Key, {error, Reason}}
+                end, Responses),
+                {ok, Responses2};
+            {error, Reason} ->
+                {error, Reason}
+        end
+    end, Timeout).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Stores key-value pair in a CouchBase database. Values of the 'none'
+%% encoder can be any iodata, which is sent without being flattened. Values
+%% of the {compressed, Codec, Encoder} encoder are encoded with Encoder and
+%% compressed by the NIF if they are not smaller than the
+%% 'compression_threshold' connect option. Values of the
+%% {compressed, {zstd, Id}, Encoder} encoder are compressed with a loaded
+%% dictionary regardless of their size, and stored uncompressed if it has
+%% not been loaded.
 %% @end
 %%--------------------------------------------------------------------
 -spec store(connection(), store_operation(), key(), value(), encoder(), cas(),
@@ -267,6 +394,149 @@ durability(Connection, Key, Cas, PersistTo, ReplicateTo, Timeout) ->
 bulk_durability(Connection, Requests, Options, Timeout) ->
     call(Connection, {durability, [Requests, Options]}, Timeout).
 
+%%--------------------------------------------------------------------
+%% @doc
+%% Trains a zstd dictionary on sample values encoded with Encoder, stores it
+%% in the bucket under the id and loads it, so that values of the
+%% {compressed, {zstd, Id}, Encoder} encoder are compressed with it. Samples
+%% should be a few hundred or more values of the kind to be compressed.
+%% Dictionaries are never replaced, as values compressed with them could not
+%% be read anymore, so training under an id in use fails with
+%% {error, key_eexists}. Ids are shared by all connections of a node.
+%% @end
+%%--------------------------------------------------------------------
+-spec train_dictionary(connection(), dictionary_id(), [value()],
+    none | json | raw, timeout()) -> ok | {error, Reason :: term()}.
+train_dictionary(Connection, Id, Samples, Encoder, Timeout) ->
+    Samples2 = [element(2, encode(Encoder, Sample)) || Sample <- Samples],
+    case cberl_nif:train_dictionary(Samples2, ?DICTIONARY_CAPACITY) of
+        {ok, Dictionary} ->
+            case store(Connection, add, ?DICTIONARY_KEY(Id), Dictionary, none,
+                0, 0, Timeout) of
+                {ok, _Cas} -> cberl_nif:load_dictionary(Id, Dictionary);
+                {error, Reason} -> {error, Reason}
+            end;
+        {error, Reason} ->
+            {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Loads a dictionary stored in the bucket by train_dictionary/5. Gets load
+%% dictionaries of the values they return on their own, so this is needed
+%% only before storing values compressed with a dictionary.
+%% @end
+%%--------------------------------------------------------------------
+-spec load_dictionary(connection(), dictionary_id(), timeout()) ->
+    ok | {error, Reason :: term()}.
+load_dictionary(Connection, Id, Timeout) ->
+    case get(Connection, ?DICTIONARY_KEY(Id), 0, false, Timeout) of
+        {ok, _Cas, Dictionary} -> cberl_nif:load_dictionary(Id, Dictionary);
+        {error, Reason} -> {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Unloads a dictionary from all connections of the node to free its memory.
+%% Values compressed with it are stored uncompressed until it is loaded
+%% again, which gets do on their own.
+%% @end
+%%--------------------------------------------------------------------
+-spec unload_dictionary(dictionary_id()) -> ok.
+unload_dictionary(Id) ->
+    cberl_nif:unload_dictionary(Id).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of keys and bytes in flight on a connection, their
+%% limits, the number of requests rejected due to overload and counters of
+%% each QoS class. For a pool, returns stats of each of its connections.
+%% @end
+%%--------------------------------------------------------------------
+-spec stats(connection()) ->
+    {ok, [{atom(), term()}]} | {error, Reason :: term()}.
+stats(Connection) ->
+    case cberl_pool:members(Connection) of
+        {ok, Members} ->
+            {ok, [{members, lists:map(fun(Member) ->
+                {ok, Stats} = stats(Member),
+                Stats
+            end, Members)}]};
+        {error, not_pool} ->
+            case get_resources(Connection) of
+                {ok, {Client, Connection2}} ->
+                    {ok, Stats} = cberl_nif:stats(Connection2),
+                    {ok, ClassStats} = cberl_nif:class_stats(Client),
+                    {ok, Stats ++ [{classes, ClassStats}]};
+                {error, Reason} ->
+                    {error, Reason}
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of keys in flight on a connection. Keys are counted
+%% until their requests complete, even if the calling processes are gone,
+%% and a connection which is not established has none.
+%% @end
+%%--------------------------------------------------------------------
+-spec inflight(connection()) -> non_neg_integer().
+inflight(Connection) ->
+    case get_resources(Connection) of
+        {ok, {_Client, Connection2}} -> cberl_nif:inflight(Connection2);
+        {error, _Reason} -> 0
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Creates or reconfigures a QoS class of the worker pool the connection
+%% uses. Classes are not owned by the connection: they are shared by, and
+%% affect the requests of, every connection using the same pool (the
+%% node-wide one unless the connection was started with its own workers).
+%% Classes of a lower priority are scheduled before the others, which gain a
+%% priority level for every 10 ms they are kept waiting, while classes of the
+%% same priority share the worker threads in proportion to their weights.
+%% Each class can be limited in operations and bytes per second (0 means no
+%% limit), counted across all those connections. The 'interactive'
+%% (priority 0) and 'batch' (priority 1) classes are always defined.
+%% @end
+%%--------------------------------------------------------------------
+-spec configure_class(connection(), class(), [class_opt()]) ->
+    ok | {error, Reason :: term()}.
+configure_class(Connection, Class, Opts) ->
+    case cberl_pool:members(Connection) of
+        {ok, Members} ->
+            lists:foreach(fun(Member) ->
+                ok = configure_class(Member, Class, Opts)
+            end, Members);
+        {error, not_pool} ->
+            case get_resources(Connection) of
+                {ok, {Client, _Connection2}} ->
+                    cberl_nif:configure_class(Client, Class,
+                        proplists:get_value(priority, Opts, 0),
+                        proplists:get_value(weight, Opts, 1),
+                        proplists:get_value(ops_per_sec, Opts, 0),
+                        proplists:get_value(bytes_per_sec, Opts, 0));
+                {error, Reason} ->
+                    {error, Reason}
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Sets QoS class of requests issued by the calling process and returns the
+%% previous one. Requests of unknown classes belong to the 'interactive'
+%% class (default). Within a class requests are scheduled earliest deadline
+%% first, based on their timeout.
+%% @end
+%%--------------------------------------------------------------------
+-spec set_class(class()) -> class().
+set_class(Class) when is_atom(Class) ->
+    case put(?CLASS_KEY, Class) of
+        undefined -> interactive;
+        OldClass -> OldClass
+    end.
+
 %%%===================================================================
 %%% gen_server callbacks
 %%%===================================================================
@@ -274,27 +544,54 @@ bulk_durability(Connection, Requests, Options, Timeout) ->
 %%--------------------------------------------------------------------
 %% @private
 %% @doc
-%% Initializes CouchBase connection.
+%% Initializes CouchBase connection. In the lazy mode the connection is
+%% established in the background, while requests wait for it to complete.
 %% @end
 %%--------------------------------------------------------------------
 -spec init(Args :: term()) ->
     {ok, State :: state()} | {ok, State :: state(), timeout() | hibernate} |
     {stop, Reason :: term()} | ignore.
 init([Host, Username, Password, Bucket, Opts, Timeout]) ->
-    {ok, Client} = cberl_nif:new(),
+    process_flag(trap_exit, true),
+    case get_client(Opts) of
+        {ok, Client} ->
+            init(Client, Host, Username, Password, Bucket, Opts, Timeout);
+        {error, Reason} ->
+            {stop, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Starts connecting on a client.
+%% @end
+%%--------------------------------------------------------------------
+-spec init(cberl_nif:client(), host(), username(), password(), bucket(),
+    [connect_opt()], timeout()) ->
+    {ok, State :: state()} | {ok, State :: state(), hibernate} |
+    {stop, Reason :: term()}.
+init(Client, Host, Username, Password, Bucket, Opts, Timeout) ->
     {ok, Ref} = cberl_nif:connect(
-        self(), Client, Host, Username, Password, Bucket, Opts
+        self(), Client, Host, Username, Password, Bucket, get_nif_opts(Opts),
+        get_config_cache(Opts)
     ),
-    receive
-        {Ref, {ok, Connection}} ->
-            {ok, #state{
-                client = Client,
-                connection = Connection
-            }};
-        {Ref, {error, Reason}} ->
-            {stop, Reason}
-    after
-        Timeout -> {stop, timeout}
+    State = #state{
+        client = Client,
+        connect_ref = Ref,
+        publish = proplists:get_value(publish, Opts, true)
+    },
+    case proplists:get_value(lazy, Opts, false) of
+        true when Timeout == infinity ->
+            {ok, State};
+        true ->
+            Timer = erlang:send_after(Timeout, self(), {Ref, {error, timeout}}),
+            {ok, State#state{connect_timer = Timer}};
+        false ->
+            receive
+                {Ref, Response} -> connected(Response, State)
+            after
+                Timeout -> {stop, timeout}
+            end
     end.
 
 %%--------------------------------------------------------------------
@@ -311,6 +608,17 @@ init([Host, Username, Password, Bucket, Opts, Timeout]) ->
     {noreply, NewState :: state(), timeout() | hibernate} |
     {stop, Reason :: term(), Reply :: term(), NewState :: state()} |
     {stop, Reason :: term(), NewState :: state()}.
+handle_call(await_connection, From, #state{connection = undefined} = State) ->
+    #state{waiters = Waiters} = State,
+    {noreply, State#state{waiters = [From | Waiters]}};
+handle_call(await_connection, _From, #state{} = State) ->
+    #state{client = Client, connection = Connection} = State,
+    {reply, {ok, {Client, Connection}}, State};
+handle_call(get_resources, _From, #state{connection = undefined} = State) ->
+    {reply, {error, not_connected}, State};
+handle_call(get_resources, _From, #state{} = State) ->
+    #state{client = Client, connection = Connection} = State,
+    {reply, {ok, {Client, Connection}}, State};
 handle_call(_Request, _From, #state{} = State) ->
     {noreply, State}.
 
@@ -324,14 +632,6 @@ handle_call(_Request, _From, #state{} = State) ->
     {noreply, NewState :: state()} |
     {noreply, NewState :: state(), timeout() | hibernate} |
     {stop, Reason :: term(), NewState :: state()}.
-handle_cast({request, Ref, From, {Function, Args}}, #state{} = State) ->
-    #state{
-        client = Client,
-        connection = Connection
-    } = State,
-    {ok, Ref2} = apply(cberl_nif, Function, [From, Client, Connection | Args]),
-    From ! {Ref, {ok, Ref2}},
-    {noreply, State};
 handle_cast(_Request, #state{} = State) ->
     {noreply, State}.
 
@@ -345,6 +645,22 @@ handle_cast(_Request, #state{} = State) ->
     {noreply, NewState :: state()} |
     {noreply, NewState :: state(), timeout() | hibernate} |
     {stop, Reason :: term(), NewState :: state()}.
+handle_info({Ref, Response}, #state{connect_ref = Ref} = State) ->
+    #state{connect_timer = Timer, waiters = Waiters} = State,
+    case Timer of
+        undefined -> ok;
+        _ -> erlang:cancel_timer(Timer)
+    end,
+    case connected(Response, State) of
+        {ok, State2, hibernate} ->
+            #state{client = Client, connection = Connection} = State2,
+            [gen_server:reply(Waiter, {ok, {Client, Connection}}) ||
+                Waiter <- Waiters],
+            {noreply, State2#state{waiters = []}, hibernate};
+        {stop, Reason} ->
+            [gen_server:reply(Waiter, {error, Reason}) || Waiter <- Waiters],
+            {stop, Reason, State#state{waiters = []}}
+    end;
 handle_info(_Info, #state{} = State) ->
     {noreply, State}.
 
@@ -359,6 +675,9 @@ handle_info(_Info, #state{} = State) ->
 %%--------------------------------------------------------------------
 -spec terminate(Reason :: (normal | shutdown | {shutdown, term()} | term()),
     State :: state()) -> term().
+terminate(_Reason, #state{publish = true} = State) ->
+    persistent_term:erase(?RESOURCES_KEY(self())),
+    State;
 terminate(_Reason, #state{} = State) ->
     State.
 
@@ -381,43 +700,225 @@ code_change(_OldVsn, State, _Extra) ->
 %% @private
 %% @doc
 %% Sends request to a CouchBase database and awaits response with timeout.
+%% The request is scheduled by the calling process directly on the NIF
+%% resources published by the connection process, or on the ones obtained
+%% from it when they are not published. Requests to a pool are sent using
+%% one of its connections.
 %% @end
 %%--------------------------------------------------------------------
 -spec call(connection(), {Function :: atom(), Args :: list()}, timeout()) ->
     cberl_nif:response() | {error, Reason :: term()}.
-call(Connection, Request, Timeout) ->
-    Ref = make_ref(),
-    gen_server:cast(Connection, {request, Ref, self(), Request}),
-    case receive_response(Ref, Timeout) of
-        {ok, ResponseRef} -> receive_response(ResponseRef, Timeout);
+call(Connection, {Function, Args}, Timeout) ->
+    case get_published_resources(Connection) of
+        {ok, Resources} ->
+            dispatch(Resources, {Function, Args}, Timeout);
+        undefined ->
+            case cberl_pool:select(Connection) of
+                {ok, Member} ->
+                    call(Member, {Function, Args}, Timeout);
+                {error, not_pool} ->
+                    await_connection(Connection, {Function, Args}, Timeout)
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Obtains NIF resources from a connection process which does not publish
+%% them, or whose connection in the lazy mode is not yet established, and
+%% sends request within the remaining time.
+%% @end
+%%--------------------------------------------------------------------
+-spec await_connection(connection(), {Function :: atom(), Args :: list()},
+    timeout()) -> cberl_nif:response() | {error, Reason :: term()}.
+await_connection(Connection, Request, Timeout) ->
+    Start = erlang:monotonic_time(millisecond),
+    try gen_server:call(Connection, await_connection, Timeout) of
+        {ok, Resources} ->
+            dispatch(Resources, Request,
+                get_remaining_timeout(Start, Timeout));
         {error, Reason} -> {error, Reason}
+    catch
+        exit:{timeout, _} -> {error, timeout};
+        exit:_ -> {error, not_connected}
     end.
 
 %%--------------------------------------------------------------------
 %% @private
 %% @doc
-%% Waits with a timeout for a response associated with a reference.
+%% Schedules request on NIF resources of a connection and awaits response
+%% with timeout.
 %% @end
 %%--------------------------------------------------------------------
--spec receive_response(reference() | cberl_nif:request_id(), timeout()) ->
-    cberl_nif:response() | {error, Reason :: term()}.
-receive_response(Ref, Timeout) ->
+-spec dispatch(resources(), {Function :: atom(), Args :: list()},
+    timeout()) -> cberl_nif:response() | {error, Reason :: term()}.
+dispatch({Client, Connection}, {Function, Args}, Timeout) ->
+    Schedule = {get_timeout_id(Timeout), get_class()},
+    case apply(cberl_nif, Function,
+        [self(), Client, Connection | Args ++ [Schedule]]) of
+        {ok, Ref, CancelToken} ->
+            receive_response(Ref, CancelToken, Timeout);
+        {error, Reason} -> {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns NIF resources published by a connection process. The entry of
+%% a process which died without terminating is erased, so that resources
+%% of a killed connection are neither used nor kept.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_published_resources(connection()) -> {ok, resources()} | undefined.
+get_published_resources(Connection) ->
+    case persistent_term:get(?RESOURCES_KEY(Connection), undefined) of
+        undefined ->
+            undefined;
+        Resources ->
+            case is_process_alive(Connection) of
+                true ->
+                    {ok, Resources};
+                false ->
+                    persistent_term:erase(?RESOURCES_KEY(Connection)),
+                    undefined
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns NIF resources of an established connection, asking the
+%% connection process for them when they are not published.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_resources(connection()) ->
+    {ok, resources()} | {error, not_connected}.
+get_resources(Connection) ->
+    case get_published_resources(Connection) of
+        {ok, Resources} ->
+            {ok, Resources};
+        undefined ->
+            try
+                gen_server:call(Connection, get_resources)
+            catch
+                exit:_ -> {error, not_connected}
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Records an established connection and publishes its NIF resources
+%% unless disabled.
+%% @end
+%%--------------------------------------------------------------------
+-spec connected({ok, cberl_nif:connection()} | {error, Reason :: term()},
+    state()) -> {ok, state(), hibernate} | {stop, Reason :: term()}.
+connected({ok, Connection}, #state{client = Client} = State) ->
+    case State of
+        #state{publish = true} ->
+            persistent_term:put(?RESOURCES_KEY(self()), {Client, Connection});
+        #state{publish = false} ->
+            ok
+    end,
+    {ok, State#state{
+        connection = Connection,
+        connect_ref = undefined,
+        connect_timer = undefined
+    }, hibernate};
+connected({error, Reason}, #state{}) ->
+    {stop, Reason}.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Waits with a timeout for a response associated with a reference. On
+%% timeout the request is cancelled, so that no late response is sent, unless
+%% it has already completed, in which case its response is returned.
+%% @end
+%%--------------------------------------------------------------------
+-spec receive_response(cberl_nif:request_id(), cberl_nif:cancel_token(),
+    timeout()) -> cberl_nif:response() | {error, Reason :: term()}.
+receive_response(Ref, CancelToken, Timeout) ->
+    case receive_reply(Ref, Timeout) of
+        {ok, Response} ->
+            Response;
+        timeout ->
+            case cberl_nif:cancel(CancelToken) of
+                ok ->
+                    {error, timeout};
+                completed ->
+                    {ok, Response} = receive_reply(Ref, infinity),
+                    Response
+            end
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Waits with a timeout for a reply associated with a reference. Replies
+%% sent by the NIF together in one message are put back in the mailbox one
+%% by one, so that the other ones are received as if sent on their own.
+%% @end
+%%--------------------------------------------------------------------
+-spec receive_reply(cberl_nif:request_id(), timeout()) ->
+    {ok, cberl_nif:response()} | timeout.
+receive_reply(Ref, Timeout) ->
+    Start = erlang:monotonic_time(millisecond),
     receive
-        {Ref, Response} -> Response
+        {Ref, Response} ->
+            {ok, Response};
+        {cberl_replies, Replies} ->
+            [self() ! Reply || Reply <- Replies],
+            receive_reply(Ref, get_remaining_timeout(Start, Timeout))
     after
-        Timeout -> {error, timeout}
+        Timeout -> timeout
     end.
 
 %%--------------------------------------------------------------------
 %% @private
 %% @doc
-%% Decodes value based on the encoding flag.
+%% Gets values with a function and, if any of them have been compressed with
+%% dictionaries which have not been loaded, loads the dictionaries from the
+%% bucket and gets those values again within the remaining time. Values
+%% locked by the first get are not got again, as they are locked already.
 %% @end
 %%--------------------------------------------------------------------
--spec decode(cberl_nif:flags(), cberl_nif:value()) -> value().
-decode(0, Value) -> Value;
-decode(1, Value) -> jiffy:decode(Value);
-decode(2, Value) -> binary_to_term(Value).
+-spec with_dictionaries(connection(), [get_request()],
+    fun(([get_request()], timeout()) ->
+        {ok, [{key(), Result}]} | {error, Reason}),
+    timeout()) -> {ok, [{key(), Result}]} | {error, Reason} when
+    Result :: term(),
+    Reason :: term().
+with_dictionaries(Connection, Requests, Get, Timeout) ->
+    Start = erlang:monotonic_time(millisecond),
+    case Get(Requests, Timeout) of
+        {ok, Responses} ->
+            case [{Key, Id} ||
+                {Key, {error, {unknown_dictionary, Id}}} <- Responses] of
+                [] ->
+                    {ok, Responses};
+                Unknown ->
+                    lists:foreach(fun(Id) ->
+                        load_dictionary(Connection, Id,
+                            get_remaining_timeout(Start, Timeout))
+                    end, lists:usort([Id || {_Key, Id} <- Unknown])),
+                    Keys = maps:from_list(Unknown),
+                    Requests2 = [Request || {Key, _Expiry, false} = Request
+                        <- Requests, maps:is_key(Key, Keys)],
+                    Timeout2 = get_remaining_timeout(Start, Timeout),
+                    case Get(Requests2, Timeout2) of
+                        {ok, Responses2} ->
+                            Results = maps:from_list(Responses2),
+                            {ok, [{Key, maps:get(Key, Results, Result)} ||
+                                {Key, Result} <- Responses]};
+                        {error, _Reason} ->
+                            {ok, Responses}
+                    end
+            end;
+        {error, Reason} ->
+            {error, Reason}
+    end.
 
 %%--------------------------------------------------------------------
 %% @private
@@ -425,10 +926,14 @@ decode(2, Value) -> binary_to_term(Value).
 %% Encodes value and returns encoding flag.
 %% @end
 %%--------------------------------------------------------------------
--spec encode(encoder(), value()) -> cberl_nif:value().
+-spec encode(encoder(), value()) ->
+    {cberl_nif:flags(), cberl_nif:store_value()}.
 encode(none, Value) -> {0, Value};
-encode(json, Value) -> {1, jiffy:encode(Value)};
-encode(raw, Value) -> {2, term_to_binary(Value)}.
+encode(json, Value) -> {1, {json, Value}};
+encode(raw, Value) -> {2, term_to_binary(Value)};
+encode({compressed, Codec, Encoder}, Value) ->
+    {EncoderId, Value2} = encode(Encoder, Value),
+    {EncoderId, {compressed, Codec, Value2}}.
 
 %%--------------------------------------------------------------------
 %% @private
@@ -466,3 +971,105 @@ get_http_method_id(get) -> 0;
 get_http_method_id(post) -> 1;
 get_http_method_id(put) -> 2;
 get_http_method_id(delete) -> 3.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Converts request timeout to a value understood by the NIF.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_timeout_id(timeout()) -> -1 | non_neg_integer().
+get_timeout_id(infinity) -> -1;
+get_timeout_id(Timeout) -> min(Timeout, ?MAX_TIMEOUT).
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns time left until a timeout started at a given time expires.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_remaining_timeout(Start :: integer(), timeout()) -> timeout().
+get_remaining_timeout(_Start, infinity) ->
+    infinity;
+get_remaining_timeout(Start, Timeout) ->
+    max(0, Timeout - (erlang:monotonic_time(millisecond) - Start)).
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns connect options understood by the NIF.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_nif_opts([connect_opt()]) -> [{atom(), integer()}].
+get_nif_opts(Opts) ->
+    lists:filtermap(fun
+        ({safe_decode, Value}) -> {true, {safe_decode, bool_to_int(Value)}};
+        ({Name, Value}) when is_integer(Value) -> {true, {Name, Value}};
+        (_) -> false
+    end, Opts).
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Converts a boolean option to an integer understood by the NIF.
+%% @end
+%%--------------------------------------------------------------------
+-spec bool_to_int(boolean()) -> 0 | 1.
+bool_to_int(true) -> 1;
+bool_to_int(false) -> 0.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns path of the cluster map cache file, or an empty binary if the cache
+%% is disabled.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_config_cache([connect_opt()]) -> binary().
+get_config_cache(Opts) ->
+    case proplists:get_value(config_cache, Opts) of
+        undefined -> <<>>;
+        Path -> unicode:characters_to_binary(Path)
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns a private client of a connection started with its own workers,
+%% or the client shared by connections. The shared client fails to be
+%% returned when it is running with a different number of workers than
+%% currently configured.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_client([connect_opt()]) ->
+    {ok, cberl_nif:client()} |
+    {error, {io_threads_mismatch, pos_integer()}}.
+get_client(Opts) ->
+    case proplists:get_value(workers, Opts) of
+        undefined -> cberl_nif:shared(get_io_threads());
+        Workers -> cberl_nif:new(Workers)
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns the number of worker threads of the client shared by connections.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_io_threads() -> pos_integer().
+get_io_threads() ->
+    application:get_env(?APP, io_threads,
+        erlang:system_info(schedulers_online)).
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Returns QoS class of the calling process.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_class() -> class().
+get_class() ->
+    case get(?CLASS_KEY) of
+        undefined -> interactive;
+        Class -> Class
+    end.
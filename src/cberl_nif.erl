@@ -14,30 +14,45 @@
 -on_load(init/0).
 
 %% API
--export([new/0, connect/7, get/4, store/4, remove/4, arithmetic/4, http/4,
-    durability/5]).
+-export([new/1, shared/1, connect/8, get/5, get_paths/6, store/5, remove/5,
+    arithmetic/5, http/5, durability/6, train_dictionary/2, load_dictionary/2,
+    unload_dictionary/1, stats/1, inflight/1, configure_class/6,
+    class_stats/1, cancel/1]).
 
 -type client() :: term().
 -type connection() :: term().
--type request_id() :: {integer(), integer(), integer()}.
+-type request_id() :: non_neg_integer().
+-type cancel_token() :: term().
+-type stats() :: [{inflight_ops | inflight_bytes | max_inflight_ops |
+                   max_inflight_bytes | rejected, non_neg_integer()}].
 
--export_type([client/0, connection/0, request_id/0]).
+-type schedule() :: {Timeout :: -1 | non_neg_integer(), cberl:class()}.
+-type class_stats() :: [{cberl:class(),
+                         [{queued | scheduled | throttled | dropped,
+                           non_neg_integer()}]
+                        }].
+
+-export_type([client/0, connection/0, request_id/0, cancel_token/0, stats/0,
+    schedule/0, class_stats/0]).
 
 -type flags() :: non_neg_integer().
--type value() :: binary().
+-type value() :: cberl:value() | [cberl:json_value() | undefined].
+-type store_value() :: iodata() | {json, cberl:json_value()} |
+                       {compressed, cberl:compression(), store_value()}.
 -type store_operation_id() :: non_neg_integer().
 -type http_type_id() :: non_neg_integer().
 -type http_method_id() :: non_neg_integer().
 
--export_type([flags/0, store_operation_id/0, http_type_id/0, http_method_id/0]).
+-export_type([flags/0, value/0, store_value/0, store_operation_id/0,
+    http_type_id/0, http_method_id/0]).
 
 -type get_request() :: cberl:get_request().
 -type get_response() :: {cberl:key(),
                            {ok, cberl:cas(), flags(), value()} |
                            {error, term()}
                         }.
--type store_request() :: {store_operation_id(), cberl:key(), value(), flags(),
-                          cberl:cas(), cberl:expiry()}.
+-type store_request() :: {store_operation_id(), cberl:key(), store_value(),
+                          flags(), cberl:cas(), cberl:expiry()}.
 -type store_response() :: cberl:store_response().
 -type remove_request() :: cberl:remove_request().
 -type remove_response() :: cberl:remove_response().
@@ -65,8 +80,19 @@
 %% Binding for NIF 'new' function.
 %% @end
 %%--------------------------------------------------------------------
--spec new() -> {ok, client()} | no_return().
-new() ->
+-spec new(Workers :: pos_integer()) -> {ok, client()} | no_return().
+new(_Workers) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'shared' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec shared(Workers :: pos_integer()) ->
+    {ok, client()} | {error, {io_threads_mismatch, pos_integer()}} |
+    no_return().
+shared(_Workers) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -75,8 +101,10 @@ new() ->
 %% @end
 %%--------------------------------------------------------------------
 -spec connect(pid(), client(), cberl:host(), cberl:username(), cberl:password(),
-    cberl:bucket(), [cberl:connect_opt()]) -> {ok, request_id()} | no_return().
-connect(_From, _Client, _Host, _Username, _Password, _Bucket, _Opts) ->
+    cberl:bucket(), [{atom(), integer()}], ConfigCache :: binary()) ->
+    {ok, request_id()} | no_return().
+connect(_From, _Client, _Host, _Username, _Password, _Bucket, _Opts,
+    _ConfigCache) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -84,9 +112,21 @@ connect(_From, _Client, _Host, _Username, _Password, _Bucket, _Opts) ->
 %% Binding for NIF 'get' function.
 %% @end
 %%--------------------------------------------------------------------
--spec get(pid(), client(), connection(), [get_request()]) ->
-    {ok, request_id()} | no_return().
-get(_From, _Client, _Connection, _Requests) ->
+-spec get(pid(), client(), connection(), [get_request()],
+    schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+get(_From, _Client, _Connection, _Requests, _Schedule) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'get_paths' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec get_paths(pid(), client(), connection(), [get_request()],
+    [cberl:json_path()], schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+get_paths(_From, _Client, _Connection, _Requests, _Paths, _Schedule) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -94,9 +134,10 @@ get(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'store' function.
 %% @end
 %%--------------------------------------------------------------------
--spec store(pid(), client(), connection(), [store_request()]) ->
-    {ok, request_id()} | no_return().
-store(_From, _Client, _Connection, _Requests) ->
+-spec store(pid(), client(), connection(), [store_request()],
+    schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+store(_From, _Client, _Connection, _Requests, _Schedule) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -104,9 +145,10 @@ store(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'remove' function.
 %% @end
 %%--------------------------------------------------------------------
--spec remove(pid(), client(), connection(), [remove_request()]) ->
-    {ok, request_id()} | no_return().
-remove(_From, _Client, _Connection, _Requests) ->
+-spec remove(pid(), client(), connection(), [remove_request()],
+    schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+remove(_From, _Client, _Connection, _Requests, _Schedule) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -114,9 +156,10 @@ remove(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'arithmetic' function.
 %% @end
 %%--------------------------------------------------------------------
--spec arithmetic(pid(), client(), connection(), [arithmetic_request()]) ->
-    {ok, request_id()} | no_return().
-arithmetic(_From, _Client, _Connection, _Requests) ->
+-spec arithmetic(pid(), client(), connection(), [arithmetic_request()],
+    schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+arithmetic(_From, _Client, _Connection, _Requests, _Schedule) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -124,9 +167,10 @@ arithmetic(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'http' function.
 %% @end
 %%--------------------------------------------------------------------
--spec http(pid(), client(), connection(), http_request()) ->
-    {ok, request_id()} | no_return().
-http(_From, _Client, _Connection, _Request) ->
+-spec http(pid(), client(), connection(), http_request(),
+    schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+http(_From, _Client, _Connection, _Request, _Schedule) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -135,8 +179,87 @@ http(_From, _Client, _Connection, _Request) ->
 %% @end
 %%--------------------------------------------------------------------
 -spec durability(pid(), client(), connection(), [durability_request()],
-    durability_options()) -> {ok, request_id()} | no_return().
-durability(_From, _Client, _Connection, _Requests, _Options) ->
+    durability_options(), schedule()) ->
+    {ok, request_id(), cancel_token()} | {error, overloaded} | no_return().
+durability(_From, _Client, _Connection, _Requests, _Options, _Schedule) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'train_dictionary' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec train_dictionary([store_value()], Capacity :: pos_integer()) ->
+    {ok, cberl:dictionary()} | {error, not_supported | training_failed} |
+    no_return().
+train_dictionary(_Samples, _Capacity) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'load_dictionary' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec load_dictionary(cberl:dictionary_id(), cberl:dictionary()) ->
+    ok | {error, not_supported | invalid_dictionary} | no_return().
+load_dictionary(_Id, _Dictionary) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'unload_dictionary' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec unload_dictionary(cberl:dictionary_id()) -> ok | no_return().
+unload_dictionary(_Id) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec stats(connection()) -> {ok, stats()} | no_return().
+stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'inflight' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec inflight(connection()) -> non_neg_integer() | no_return().
+inflight(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'configure_class' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec configure_class(client(), cberl:class(), Priority :: non_neg_integer(),
+    Weight :: pos_integer(), OpsPerSec :: non_neg_integer(),
+    BytesPerSec :: non_neg_integer()) -> ok | no_return().
+configure_class(_Client, _Class, _Priority, _Weight, _OpsPerSec,
+    _BytesPerSec) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'class_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec class_stats(client()) -> {ok, class_stats()} | no_return().
+class_stats(_Client) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'cancel' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec cancel(cancel_token()) -> ok | completed | no_return().
+cancel(_CancelToken) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%%===================================================================
@@ -0,0 +1,232 @@
+%%%-------------------------------------------------------------------
+%%% @author Krzysztof Trzepla
+%%% @copyright (C) 2017: Krzysztof Trzepla
+%%% This software is released under the MIT license cited in 'LICENSE.md'.
+%%% @end
+%%%-------------------------------------------------------------------
+%%% @doc
+%%% This module implements a pool of CouchBase connections. Requests are
+%%% routed to the less busy of two connections: the one tied to the
+%%% scheduler of the calling process and a random one. A connection is as
+%%% busy as the number of keys in flight on it, which its NIF resources
+%%% count until the requests complete, so that requests abandoned by killed
+%%% callers are not counted forever.
+%%% @end
+%%%-------------------------------------------------------------------
+-module(cberl_pool).
+-author("Krzysztof Trzepla").
+
+-behaviour(gen_server).
+
+%% API
+-export([start_link/7, stop/1, select/1, members/1]).
+
+%% gen_server callbacks
+-export([init/1, handle_call/3, handle_cast/2, handle_info/2, terminate/2,
+    code_change/3]).
+
+-type pool() :: pid().
+
+-export_type([pool/0]).
+
+-define(POOL_KEY(Pool), {?MODULE, Pool}).
+
+-record(state, {
+    members :: [cberl:connection()]
+}).
+
+-type state() :: #state{}.
+
+%%%===================================================================
+%%% API
+%%%===================================================================
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Starts a pool of connections to a CouchBase database.
+%% @end
+%%--------------------------------------------------------------------
+-spec start_link(Size :: pos_integer(), cberl:host(), cberl:username(),
+    cberl:password(), cberl:bucket(), [cberl:connect_opt()], timeout()) ->
+    {ok, pool()} | {error, Reason :: term()}.
+start_link(Size, Host, Username, Password, Bucket, Opts, Timeout) ->
+    gen_server:start_link(?MODULE, [
+        Size, Host, Username, Password, Bucket, Opts, Timeout
+    ], []).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Stops a pool and closes its connections.
+%% @end
+%%--------------------------------------------------------------------
+-spec stop(pool()) -> ok.
+stop(Pool) ->
+    gen_server:stop(Pool).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Selects a connection of a pool to send a request to.
+%% @end
+%%--------------------------------------------------------------------
+-spec select(pool()) -> {ok, cberl:connection()} | {error, not_pool}.
+select(Pool) ->
+    case persistent_term:get(?POOL_KEY(Pool), undefined) of
+        undefined -> {error, not_pool};
+        Members -> {ok, pick(Members, tuple_size(Members))}
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns connections of a pool.
+%% @end
+%%--------------------------------------------------------------------
+-spec members(pool()) -> {ok, [cberl:connection()]} | {error, not_pool}.
+members(Pool) ->
+    case persistent_term:get(?POOL_KEY(Pool), undefined) of
+        undefined -> {error, not_pool};
+        Members -> {ok, tuple_to_list(Members)}
+    end.
+
+%%%===================================================================
+%%% gen_server callbacks
+%%%===================================================================
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Initializes pool connections.
+%% @end
+%%--------------------------------------------------------------------
+-spec init(Args :: term()) ->
+    {ok, State :: state()} | {ok, State :: state(), timeout() | hibernate} |
+    {stop, Reason :: term()} | ignore.
+init([Size, Host, Username, Password, Bucket, Opts, Timeout]) ->
+    process_flag(trap_exit, true),
+    case connect(Size, Host, Username, Password, Bucket, Opts, Timeout, []) of
+        {ok, Members} ->
+            persistent_term:put(?POOL_KEY(self()), list_to_tuple(Members)),
+            {ok, #state{members = Members}, hibernate};
+        {error, Reason} ->
+            {stop, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Handles call messages.
+%% @end
+%%--------------------------------------------------------------------
+-spec handle_call(Request :: term(), From :: {pid(), Tag :: term()},
+    State :: state()) ->
+    {reply, Reply :: term(), NewState :: state()} |
+    {reply, Reply :: term(), NewState :: state(), timeout() | hibernate} |
+    {noreply, NewState :: state()} |
+    {noreply, NewState :: state(), timeout() | hibernate} |
+    {stop, Reason :: term(), Reply :: term(), NewState :: state()} |
+    {stop, Reason :: term(), NewState :: state()}.
+handle_call(_Request, _From, #state{} = State) ->
+    {noreply, State}.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Handles cast messages.
+%% @end
+%%--------------------------------------------------------------------
+-spec handle_cast(Request :: term(), State :: state()) ->
+    {noreply, NewState :: state()} |
+    {noreply, NewState :: state(), timeout() | hibernate} |
+    {stop, Reason :: term(), NewState :: state()}.
+handle_cast(_Request, #state{} = State) ->
+    {noreply, State}.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Handles all non call/cast messages. The pool stops when any of its
+%% connections does.
+%% @end
+%%--------------------------------------------------------------------
+-spec handle_info(Info :: timeout() | term(), State :: state()) ->
+    {noreply, NewState :: state()} |
+    {noreply, NewState :: state(), timeout() | hibernate} |
+    {stop, Reason :: term(), NewState :: state()}.
+handle_info({'EXIT', Pid, Reason}, #state{members = Members} = State) ->
+    case lists:member(Pid, Members) of
+        true -> {stop, {connection_down, Reason}, State};
+        false -> {stop, Reason, State}
+    end;
+handle_info(_Info, #state{} = State) ->
+    {noreply, State}.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% This function is called by a gen_server when it is about to
+%% terminate. It should be the opposite of Module:init/1 and do any
+%% necessary cleaning up. When it returns, the gen_server terminates
+%% with Reason. The return value is ignored.
+%% @end
+%%--------------------------------------------------------------------
+-spec terminate(Reason :: (normal | shutdown | {shutdown, term()} | term()),
+    State :: state()) -> term().
+terminate(_Reason, #state{} = State) ->
+    persistent_term:erase(?POOL_KEY(self())),
+    State.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Converts process state when code is changed.
+%% @end
+%%--------------------------------------------------------------------
+-spec code_change(OldVsn :: term() | {down, term()}, State :: state(),
+    Extra :: term()) -> {ok, NewState :: state()} | {error, Reason :: term()}.
+code_change(_OldVsn, State, _Extra) ->
+    {ok, State}.
+
+%%%===================================================================
+%%% Internal functions
+%%%===================================================================
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Starts pool connections. Connections started before a failure exit
+%% together with the pool process.
+%% @end
+%%--------------------------------------------------------------------
+-spec connect(non_neg_integer(), cberl:host(), cberl:username(),
+    cberl:password(), cberl:bucket(), [cberl:connect_opt()], timeout(),
+    [cberl:connection()]) ->
+    {ok, [cberl:connection()]} | {error, Reason :: term()}.
+connect(0, _Host, _Username, _Password, _Bucket, _Opts, _Timeout, Members) ->
+    {ok, lists:reverse(Members)};
+connect(Size, Host, Username, Password, Bucket, Opts, Timeout, Members) ->
+    case cberl:connect(Host, Username, Password, Bucket, Opts, Timeout) of
+        {ok, Member} ->
+            connect(Size - 1, Host, Username, Password, Bucket, Opts, Timeout,
+                [Member | Members]);
+        {error, Reason} ->
+            {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Chooses the connection with fewer keys in flight out of the one tied to
+%% the scheduler of the calling process and a random one. Ties are resolved
+%% in favour of the former, which keeps requests of a scheduler on the same
+%% connection while it is not busier than the others.
+%% @end
+%%--------------------------------------------------------------------
+-spec pick(tuple(), pos_integer()) -> cberl:connection().
+pick(Members, 1) ->
+    element(1, Members);
+pick(Members, Size) ->
+    Local = element(erlang:system_info(scheduler_id) rem Size + 1, Members),
+    Random = element(rand:uniform(Size), Members),
+    case cberl:inflight(Random) < cberl:inflight(Local) of
+        true -> Random;
+        false -> Local
+    end.
@@ -27,7 +27,25 @@
     arithmetic_test/1,
     bulk_arithmetic_test/1,
     durability_test/1,
-    bulk_durability_test/1
+    bulk_durability_test/1,
+    batched_get_test/1,
+    single_flight_test/1,
+    stats_test/1,
+    overload_test/1,
+    qos_class_test/1,
+    key_order_test/1,
+    timeout_test/1,
+    pool_test/1,
+    lazy_connect_test/1,
+    io_threads_test/1,
+    publish_test/1,
+    config_cache_test/1,
+    iodata_store_test/1,
+    json_test/1,
+    get_paths_test/1,
+    safe_decode_test/1,
+    compression_test/1,
+    dictionary_test/1
 ]).
 
 all() -> [
@@ -40,7 +58,25 @@ all() -> [
     arithmetic_test,
     bulk_arithmetic_test,
     durability_test,
-    bulk_durability_test
+    bulk_durability_test,
+    batched_get_test,
+    single_flight_test,
+    stats_test,
+    overload_test,
+    qos_class_test,
+    key_order_test,
+    timeout_test,
+    pool_test,
+    lazy_connect_test,
+    io_threads_test,
+    publish_test,
+    config_cache_test,
+    iodata_store_test,
+    json_test,
+    get_paths_test,
+    safe_decode_test,
+    compression_test,
+    dictionary_test
 ].
 
 -define(TIMEOUT, timer:seconds(5)).
@@ -104,7 +140,8 @@ bulk_get_test(Config) ->
         {<<"k1">>, 0, false},
         {<<"k2">>, 0, false},
         {<<"k3">>, 0, false}
-    ], ?TIMEOUT).
+    ], ?TIMEOUT),
+    {ok, []} = cberl:bulk_get(C, [], ?TIMEOUT).
 
 remove_test(Config) ->
     C = ?config(connection, Config),
@@ -131,7 +168,8 @@ bulk_remove_test(Config) ->
         {<<"k1">>, 0},
         {<<"k2">>, 0},
         {<<"k3">>, 0}
-    ], ?TIMEOUT).
+    ], ?TIMEOUT),
+    {ok, []} = cberl:bulk_remove(C, [], ?TIMEOUT).
 
 arithmetic_test(Config) ->
     C = ?config(connection, Config),
@@ -184,11 +222,432 @@ bulk_durability_test(Config) ->
         {<<"k3">>, 0}
     ], {1, -1}, ?TIMEOUT).
 
+batched_get_test(Config) ->
+    C = ?config(connection, Config),
+    Keys = [<<"k7">>, <<"k8">>, <<"k9">>, <<"k7">>],
+    lists:foreach(fun(Key) ->
+        {ok, _} = cberl:store(C, set, Key, Key, none, 0, 0, ?TIMEOUT)
+    end, Keys),
+    Self = self(),
+    lists:foreach(fun(Key) ->
+        spawn_link(fun() ->
+            Self ! {Key, cberl:get(C, Key, 0, false, ?TIMEOUT)}
+        end)
+    end, Keys),
+    lists:foreach(fun(Key) ->
+        receive {Key, {ok, _, Key}} -> ok end
+    end, Keys).
+
+single_flight_test(Config) ->
+    C = ?config(connection, Config),
+    [{K1, R1}, {K2, R2}] = Expected = lists:map(fun({Key, Value}) ->
+        {ok, Cas} = cberl:store(C, set, Key, Value, none, 0, 0, ?TIMEOUT),
+        {Key, {ok, Cas, Value}}
+    end, [{<<"k1">>, <<"v1">>}, {<<"k2">>, <<"v2">>}]),
+    % A key repeated in a bulk get is fetched once, but answered for every
+    % occurrence. Responses of a shared fetch may come out of request order.
+    {ok, Responses} = cberl:bulk_get(C, [
+        {K1, 0, false}, {K2, 0, false}, {K1, 0, false}, {K1, 0, false}
+    ], ?TIMEOUT),
+    Sorted = lists:sort([{K1, R1}, {K2, R2}, {K1, R1}, {K1, R1}]),
+    Sorted = lists:sort(Responses),
+    % Concurrent gets of a key from many processes share its fetch in flight.
+    Self = self(),
+    Callers = lists:map(fun(N) ->
+        {Key, Result} = lists:nth(N rem 2 + 1, Expected),
+        Ref = make_ref(),
+        spawn_link(fun() ->
+            Self ! {Ref, cberl:get(C, Key, 0, false, ?TIMEOUT)}
+        end),
+        {Ref, Result}
+    end, lists:seq(1, 50)),
+    lists:foreach(fun({Ref, Result}) ->
+        receive
+            {Ref, Reply} -> Result = Reply
+        after
+            ?TIMEOUT -> ct:fail(no_reply)
+        end
+    end, Callers),
+    % A get issued after a write never shares a fetch sent before it, while
+    % other processes keep fetches of the key in flight.
+    Readers = [spawn_link(fun Read() ->
+        {ok, _, _} = cberl:get(C, K1, 0, false, ?TIMEOUT),
+        Read()
+    end) || _ <- lists:seq(1, 4)],
+    lists:foreach(fun(N) ->
+        Value = integer_to_binary(N),
+        {ok, Cas} = cberl:store(C, set, K1, Value, none, 0, 0, ?TIMEOUT),
+        {ok, Cas, Value} = cberl:get(C, K1, 0, false, ?TIMEOUT)
+    end, lists:seq(1, 100)),
+    lists:foreach(fun(Reader) ->
+        unlink(Reader),
+        exit(Reader, kill)
+    end, Readers).
+
+stats_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, Stats} = cberl:stats(C),
+    0 = proplists:get_value(inflight_ops, Stats),
+    0 = proplists:get_value(inflight_bytes, Stats),
+    100 = proplists:get_value(max_inflight_ops, Stats),
+    1024 = proplists:get_value(max_inflight_bytes, Stats).
+
+overload_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    % The second get of a class limited to one operation per second waits in
+    % the queue, holding the only key the connection lets in flight.
+    ok = cberl:configure_class(C, trickle, [{ops_per_sec, 1}]),
+    Self = self(),
+    spawn_link(fun() ->
+        interactive = cberl:set_class(trickle),
+        {ok, _, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+        Self ! {held, cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT)}
+    end),
+    await_inflight(C, 1),
+    {error, overloaded} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {error, overloaded} = cberl:bulk_store(C, [
+        {set, <<"k2">>, <<"v2">>, none, 0, 0}
+    ], ?TIMEOUT),
+    receive
+        {held, Held} -> {ok, _, <<"v1">>} = Held
+    after
+        ?TIMEOUT -> ct:fail(held_request_timeout)
+    end,
+    {ok, Stats} = cberl:stats(C),
+    0 = proplists:get_value(inflight_ops, Stats),
+    2 = proplists:get_value(rejected, Stats),
+    {ok, _Cas, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT).
+
+qos_class_test(Config) ->
+    C = ?config(connection, Config),
+    ok = cberl:configure_class(C, reports, [{weight, 2}, {ops_per_sec, 100}]),
+    interactive = cberl:set_class(reports),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, _Cas, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    reports = cberl:set_class(interactive),
+    {ok, Stats} = cberl:stats(C),
+    Classes = proplists:get_value(classes, Stats),
+    ClassStats = proplists:get_value(reports, Classes),
+    0 = proplists:get_value(queued, ClassStats),
+    Scheduled = proplists:get_value(scheduled, ClassStats),
+    true = Scheduled >= 2,
+    % Requests held back by the limits are counted once each.
+    true = proplists:get_value(throttled, ClassStats) =< Scheduled.
+
+key_order_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v0">>, none, 0, 0, ?TIMEOUT),
+    % A store held back by its class is not overtaken by a later store of the
+    % same key, although the later one is due earlier and its class is free.
+    ok = cberl:configure_class(C, trickle, [{ops_per_sec, 1}]),
+    Self = self(),
+    spawn_link(fun() ->
+        interactive = cberl:set_class(trickle),
+        {ok, _, <<"v0">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+        Self ! {held, cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0,
+            ?TIMEOUT)}
+    end),
+    await_queued(C, trickle, 1),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v2">>, none, 0, 0,
+        ?TIMEOUT div 2),
+    receive
+        {held, Held} -> {ok, _} = Held
+    after
+        ?TIMEOUT -> ct:fail(held_request_timeout)
+    end,
+    {ok, _Cas, <<"v2">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT).
+
+timeout_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    lists:foreach(fun(_) ->
+        case cberl:get(C, <<"k1">>, 0, false, 0) of
+            {ok, _Cas, <<"v1">>} -> ok;
+            {error, timeout} -> ok
+        end
+    end, lists:seq(1, 100)),
+    timer:sleep(100),
+    {messages, []} = process_info(self(), messages).
+
+pool_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, _Cas, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, [{members, Members}]} = cberl:stats(C),
+    2 = length(Members),
+    lists:foreach(fun(Stats) ->
+        0 = proplists:get_value(inflight_ops, Stats)
+    end, Members),
+    % A request of a killed caller is counted only until it completes.
+    ok = cberl:configure_class(C, trickle, [{ops_per_sec, 1}]),
+    Caller = spawn(fun() ->
+        interactive = cberl:set_class(trickle),
+        {ok, _, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+        cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT)
+    end),
+    await_pool_inflight(C, 1),
+    exit(Caller, kill),
+    await_pool_inflight(C, 0).
+
+lazy_connect_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, _Cas, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    % A lazy connection may wait for the cluster forever.
+    [{connection, C2} | _] = connect([{lazy, true}],
+        [{connect_timeout, infinity} | Config]),
+    {ok, _Cas, <<"v1">>} = cberl:get(C2, <<"k1">>, 0, false, ?TIMEOUT).
+
+io_threads_test(Config) ->
+    % The shared pool keeps its size while the connection of the test case
+    % is open.
+    Size = application:get_env(cberl, io_threads,
+        erlang:system_info(schedulers_online)),
+    ok = application:set_env(cberl, io_threads, Size + 1),
+    process_flag(trap_exit, true),
+    try
+        {error, {io_threads_mismatch, Size}} = cberl:connect(<<"127.0.0.1">>,
+            <<>>, <<>>, <<"default">>, [], ?TIMEOUT)
+    after
+        ok = application:set_env(cberl, io_threads, Size)
+    end,
+    [{connection, C} | _] = connect([], Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT).
+
+publish_test(Config) ->
+    C = ?config(connection, Config),
+    undefined = persistent_term:get({cberl, C}, undefined),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, _Cas, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, _Stats} = cberl:stats(C),
+    % Resources of a killed connection are neither used nor kept.
+    [{connection, C2} | _] = connect([], Config),
+    {_, _} = persistent_term:get({cberl, C2}),
+    unlink(C2),
+    Ref = monitor(process, C2),
+    exit(C2, kill),
+    receive {'DOWN', Ref, process, C2, killed} -> ok end,
+    {error, not_connected} = cberl:get(C2, <<"k1">>, 0, false, ?TIMEOUT),
+    undefined = persistent_term:get({cberl, C2}, undefined).
+
+config_cache_test(Config) ->
+    C = ?config(connection, Config),
+    Path = ?config(config_cache, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, Cache} = file:read_file(Path),
+    true = byte_size(Cache) > 0,
+    % The next connection bootstraps from the cluster map written by the
+    % first one.
+    [{connection, C2} | _] = connect([{config_cache, Path}], Config),
+    {ok, _Cas, <<"v1">>} = cberl:get(C2, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, Cache2} = file:read_file(Path),
+    true = byte_size(Cache2) > 0.
+
+iodata_store_test(Config) ->
+    C = ?config(connection, Config),
+    Large = binary:copy(<<"x">>, 1024),
+    Value = [<<"v">>, [Large, $1], <<>>, [] | <<"2">>],
+    {ok, _} = cberl:store(C, set, <<"k1">>, Value, none, 0, 0, ?TIMEOUT),
+    Expected = iolist_to_binary(Value),
+    {ok, _Cas, Expected} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, _} = cberl:store(C, set, <<"k2">>, [<<"v">>, Large], none, 0, 0,
+        ?TIMEOUT),
+    Expected2 = <<"v", Large/binary>>,
+    {ok, _Cas2, Expected2} = cberl:get(C, <<"k2">>, 0, false, ?TIMEOUT).
+
+json_test(Config) ->
+    C = ?config(connection, Config),
+    Value = {[
+        {<<"string">>, <<"a \"quoted\"\n\\ \x{e9}\x{1f600}"/utf8>>},
+        {<<"numbers">>, [0, -1, 18446744073709551615, 0.1, -2.5e-10]},
+        {<<"literals">>, [true, false, null]},
+        {<<"nested">>, {[{<<"empty">>, {[]}}, {<<"list">>, [[], [{[]}]]}]}}
+    ]},
+    {ok, _} = cberl:store(C, set, <<"k1">>, Value, json, 0, 0, ?TIMEOUT),
+    {ok, _Cas, Value} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, _} = cberl:store(C, set, <<"k2">>, #{key => <<"v">>}, json, 0, 0,
+        ?TIMEOUT),
+    {ok, _Cas2, {[{<<"key">>, <<"v">>}]}} =
+        cberl:get(C, <<"k2">>, 0, false, ?TIMEOUT).
+
+get_paths_test(Config) ->
+    C = ?config(connection, Config),
+    Value = {[
+        {<<"name">>, <<"v">>},
+        {<<"skipped">>, {[{<<"s">>, [<<"]}">>, {[]}]}]}},
+        {<<"tags">>, [1, {[{<<"k">>, null}]}]}
+    ]},
+    {ok, Cas} = cberl:store(C, set, <<"k1">>, Value, json, 0, 0, ?TIMEOUT),
+    {ok, Cas, [<<"v">>, null, 1, undefined, undefined, Value]} =
+        cberl:get_paths(C, <<"k1">>, [
+            [<<"name">>], [<<"tags">>, 1, <<"k">>], [<<"tags">>, 0],
+            [<<"tags">>, 2], [<<"missing">>], []
+        ], ?TIMEOUT),
+    {ok, _} = cberl:store(C, set, <<"k2">>, <<"v2">>, none, 0, 0, ?TIMEOUT),
+    {ok, [
+        {<<"k1">>, {ok, Cas, [<<"v">>]}},
+        {<<"k2">>, {error, not_json}}
+    ]} = cberl:bulk_get_paths(C, [
+        {<<"k1">>, 0, false},
+        {<<"k2">>, 0, false}
+    ], [[<<"name">>]], ?TIMEOUT).
+
+safe_decode_test(Config) ->
+    C = ?config(connection, Config),
+    Value = {v, [1, 2.5, <<"b">>], #{k => self()}},
+    {ok, Cas} = cberl:store(C, set, <<"k1">>, Value, raw, 0, 0, ?TIMEOUT),
+    {ok, Cas, Value} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    % A term holding an atom this node has never created is written as raw
+    % external format: prepending keeps the flags of the raw value, and the
+    % prefix opens a tuple of the new atom and a binary holding that value.
+    Name = <<"cberl_never_created_",
+        (integer_to_binary(erlang:unique_integer([positive])))/binary>>,
+    {'EXIT', {badarg, _}} = (catch binary_to_existing_atom(Name, utf8)),
+    Stored = term_to_binary(v),
+    {ok, _} = cberl:store(C, set, <<"k2">>, v, raw, 0, 0, ?TIMEOUT),
+    Prefix = <<131, 104, 2, 119, (byte_size(Name)), Name/binary,
+        109, (byte_size(Stored)):32>>,
+    {ok, _} = cberl:store(C, prepend, <<"k2">>, Prefix, none, 0, 0, ?TIMEOUT),
+    {error, invalid_term} = cberl:get(C, <<"k2">>, 0, false, ?TIMEOUT),
+    {'EXIT', {badarg, _}} = (catch binary_to_existing_atom(Name, utf8)),
+    [{connection, C2} | _] = connect([], Config),
+    {ok, _, {Atom, Stored}} = cberl:get(C2, <<"k2">>, 0, false, ?TIMEOUT),
+    Name = atom_to_binary(Atom, utf8).
+
+compression_test(Config) ->
+    C = ?config(connection, Config),
+    Large = binary:copy(<<"compressible ">>, 1024),
+    Json = {[{<<"k">>, Large}, {<<"l">>, lists:seq(1, 256)}]},
+    lists:foreach(fun({Key, Value, Encoder}) ->
+        {ok, Cas} = cberl:store(C, set, Key, Value, Encoder, 0, 0, ?TIMEOUT),
+        {ok, Cas, Value} = cberl:get(C, Key, 0, false, ?TIMEOUT)
+    end, [
+        {<<"k1">>, Large, {compressed, lz4, none}},
+        {<<"k2">>, Json, {compressed, zstd, json}},
+        {<<"k3">>, {v, Large}, {compressed, zstd, raw}},
+        {<<"k4">>, <<"small">>, {compressed, lz4, none}}
+    ]),
+    {ok, _, [Large]} = cberl:get_paths(C, <<"k2">>, [[<<"k">>]], ?TIMEOUT),
+    lists:foreach(fun(Operation) ->
+        {ok, _} = cberl:store(C, set, <<"k5">>, Large, none, 0, 0, ?TIMEOUT),
+        {ok, _} = cberl:store(C, Operation, <<"k5">>, Large,
+            {compressed, zstd, none}, 0, 0, ?TIMEOUT),
+        Joined = <<Large/binary, Large/binary>>,
+        {ok, _, Joined} = cberl:get(C, <<"k5">>, 0, false, ?TIMEOUT)
+    end, [append, prepend]),
+    % Values stored after a compressed one in a bulk request are stored as
+    % they are, so appending to them joins the values.
+    {ok, [{<<"k6">>, {ok, _}}, {<<"k7">>, {ok, _}}]} = cberl:bulk_store(C, [
+        {set, <<"k6">>, Large, {compressed, zstd, none}, 0, 0},
+        {set, <<"k7">>, Large, none, 0, 0}
+    ], ?TIMEOUT),
+    {ok, _} = cberl:store(C, append, <<"k7">>, <<"tail">>, none, 0, 0,
+        ?TIMEOUT),
+    Appended = <<Large/binary, "tail">>,
+    {ok, [{<<"k6">>, {ok, _, Large}}, {<<"k7">>, {ok, _, Appended}}]} =
+        cberl:bulk_get(C, [{<<"k6">>, 0, false}, {<<"k7">>, 0, false}],
+            ?TIMEOUT),
+    % Appending to a compressed value leaves its flags as they are, so the
+    % value cannot be decompressed anymore.
+    {ok, _} = cberl:store(C, append, <<"k1">>, <<"tail">>, none, 0, 0,
+        ?TIMEOUT),
+    {error, invalid_compression} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT).
+
+dictionary_test(Config) ->
+    C = ?config(connection, Config),
+    cberl:remove(C, <<"cberl_dictionary:1">>, 0, ?TIMEOUT),
+    Docs = [{[
+        {<<"id">>, I},
+        {<<"name">>, <<"user", (integer_to_binary(I))/binary>>},
+        {<<"status">>, <<"active">>},
+        {<<"roles">>, [<<"reader">>, <<"writer">>]}
+    ]} || I <- lists:seq(1, 1000)],
+    ok = cberl:train_dictionary(C, 1, Docs, json, ?TIMEOUT),
+    {error, key_eexists} = cberl:train_dictionary(C, 1, Docs, json, ?TIMEOUT),
+    Doc = hd(Docs),
+    Encoder = {compressed, {zstd, 1}, json},
+    {ok, Cas} = cberl:store(C, set, <<"k1">>, Doc, Encoder, 0, 0, ?TIMEOUT),
+    {ok, Cas, Doc} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    ok = cberl:load_dictionary(C, 1, ?TIMEOUT),
+    {error, key_enoent} = cberl:load_dictionary(C, 2, ?TIMEOUT),
+    % Values compressed with a dictionary missing from the node are got after
+    % loading it from the bucket.
+    ok = cberl:unload_dictionary(1),
+    {ok, Cas, Doc} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    ok = cberl:unload_dictionary(1),
+    {ok, [{<<"k1">>, {ok, Cas, Doc}}, {<<"k1">>, {ok, Cas, Doc}}]} =
+        cberl:bulk_get(C, [{<<"k1">>, 0, false}, {<<"k1">>, 0, false}],
+            ?TIMEOUT),
+    % Without the dictionary in the bucket the error is returned.
+    ok = cberl:unload_dictionary(1),
+    ok = cberl:remove(C, <<"cberl_dictionary:1">>, 0, ?TIMEOUT),
+    {error, {unknown_dictionary, 1}} = cberl:get(C, <<"k1">>, 0, false,
+        ?TIMEOUT).
+
 %%%===================================================================
 %%% Init/teardown functions
 %%%===================================================================
 
+init_per_testcase(batched_get_test, Config) ->
+    connect([{batch_window, 10000}, {batch_size, 3}], Config);
+init_per_testcase(stats_test, Config) ->
+    connect([{max_inflight_ops, 100}, {max_inflight_bytes, 1024}], Config);
+init_per_testcase(overload_test, Config) ->
+    connect([{max_inflight_ops, 1}], Config);
+init_per_testcase(safe_decode_test, Config) ->
+    connect([{safe_decode, true}], Config);
+init_per_testcase(lazy_connect_test, Config) ->
+    connect([{lazy, true}], Config);
+init_per_testcase(publish_test, Config) ->
+    connect([{publish, false}], Config);
+init_per_testcase(config_cache_test, Config) ->
+    Path = filename:join(?config(priv_dir, Config), "cberl.cache"),
+    file:delete(Path),
+    connect([{config_cache, Path}], [{config_cache, Path} | Config]);
+init_per_testcase(pool_test, Config) ->
+    connect([], [{pool_size, 2} | Config]);
 init_per_testcase(_Case, Config) ->
+    connect([], Config).
+
+%%%===================================================================
+%%% Internal functions
+%%%===================================================================
+
+await_inflight(C, Ops) ->
+    {ok, Stats} = cberl:stats(C),
+    case proplists:get_value(inflight_ops, Stats) of
+        Ops ->
+            ok;
+        _ ->
+            timer:sleep(10),
+            await_inflight(C, Ops)
+    end.
+
+await_pool_inflight(P, Ops) ->
+    {ok, [{members, Members}]} = cberl:stats(P),
+    case lists:sum([proplists:get_value(inflight_ops, M) || M <- Members]) of
+        Ops ->
+            ok;
+        _ ->
+            timer:sleep(10),
+            await_pool_inflight(P, Ops)
+    end.
+
+await_queued(C, Class, Ops) ->
+    {ok, Stats} = cberl:stats(C),
+    Classes = proplists:get_value(classes, Stats),
+    ClassStats = proplists:get_value(Class, Classes),
+    case proplists:get_value(queued, ClassStats) of
+        Ops ->
+            ok;
+        _ ->
+            timer:sleep(10),
+            await_queued(C, Class, Ops)
+    end.
+
+connect(ExtraOpts, Config) ->
     Host = proplists:get_value(host, Config, <<"127.0.0.1">>),
     Username = proplists:get_value(username, Config, <<>>),
     Password = proplists:get_value(password, Config, <<>>),
@@ -200,6 +659,13 @@ init_per_testcase(_Case, Config) ->
         {durability_interval, 10000},
         {durability_timeout, 30000000},
         {http_timeout, 10000000}
-    ],
-    {ok, C} = cberl:connect(Host, Username, Password, Bucket, Opts, ?TIMEOUT),
+    ] ++ ExtraOpts,
+    Timeout = proplists:get_value(connect_timeout, Config, ?TIMEOUT),
+    {ok, C} = case proplists:get_value(pool_size, Config) of
+        undefined ->
+            cberl:connect(Host, Username, Password, Bucket, Opts, Timeout);
+        Size ->
+            cberl:start_pool(Size, Host, Username, Password, Bucket, Opts,
+                Timeout)
+    end,
     [{connection, C} | Config].